@@ -0,0 +1,363 @@
+//
+#pragma once
+
+#include "CompositeBusyLevel.h"
+#include <atomic>
+#include <vector>
+
+struct admission_result_e
+{
+	enum TYPE : uint8_t
+	{
+		admitted, // 바로 입장
+		queued,	  // 대기표 발행, drain에서 입장
+		rejected  // 대기열 가득 참
+	};
+};
+
+/**
+BUSY_WARN(월드-포화) 상태에서 대기표를 발행하는 입장 대기열
+- 대기표(ticket)는 단조 증가하며 고정 크기 ring에 보관한다. 등록은 O(1), 취소는 O(log n)
+- 순번은 (ticket - head) - (head와 ticket 사이의 취소 수)로 계산한다. 취소 수는 ring 위의 fenwick tree로 유지
+- 입장 요청(request)은 대기자가 없고 BUSY_IDLE이면 바로 입장, 아니면 대기표를 발행한다.
+- 입장 허용량은 BusyLevel 평균값과 ServerBalancer 여유 인원(fillHeadroom)으로 결정한다.
+  BUSY_WARN 미만(입장제한)이면 허용량을 0으로 비워 회복 직후 몰려 들어오지 않게 한다.
+- 채널 세션은 instance()를 사용하며 Session::setCertified에서 요청, onClose에서 취소한다.
+- 순번 알림은 변화가 m_position_step 이상인 대기자만 한번에 max_count 만큼 모아서 돌려준다.
+*/
+class AdmissionQueue
+	: public LoggerBaseInfo
+{
+public:
+	static const uint64_t INVALID_TICKET = ~uint64_t(0);
+
+	struct position_update_t
+	{
+		uint64_t m_session_id;
+		uint64_t m_ticket;
+		int32_t m_position; ///< 1부터 시작
+	};
+
+public:
+	/// capacity는 2의 거듭제곱으로 올림한다.
+	explicit AdmissionQueue(uint32_t capacity = 1 << 17)
+	{
+		setDefaultLoggerName("admission.queue");
+
+		uint32_t ring_size = 1;
+		while (ring_size < capacity)
+		{
+			ring_size <<= 1;
+		}
+		m_ring_size = ring_size;
+		m_ring_mask = ring_size - 1;
+		m_entries.resize(ring_size);
+		m_cancelled_tree.assign(ring_size + 1, 0);
+	}
+
+	/// 채널 입장 대기열
+	static AdmissionQueue &instance()
+	{
+		static AdmissionQueue s_instance;
+		return s_instance;
+	}
+
+public:
+	void setMaxAdmitPerSec(float max_admit_per_sec)
+	{
+		m_max_admit_per_sec = max_admit_per_sec;
+	}
+
+	void setPositionStep(int32_t position_step)
+	{
+		m_position_step = std::max(position_step, 1);
+	}
+
+	/// 입장 판단 기준, 설정하지 않으면 모두 바로 입장한다. 서버 시작시 한번 설정
+	void setBusyLevelSource(const CompositeBusyLevel *composite_busy_level)
+	{
+		m_busy_level_source.store(composite_busy_level, std::memory_order_release);
+	}
+
+	const CompositeBusyLevel *busyLevelSource() const
+	{
+		return m_busy_level_source.load(std::memory_order_acquire);
+	}
+
+	/// 입장 요청, 대기자가 없고 BUSY_IDLE이면 바로 입장한다. queued인 경우 out_ticket에 대기표
+	admission_result_e::TYPE request(uint64_t session_id, BusyLevel_e::TYPE busy_level, _out uint64_t &out_ticket)
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		out_ticket = INVALID_TICKET;
+		if (0 == m_waiting_count && BusyLevel_e::BUSY_IDLE <= busy_level)
+		{
+			return admission_result_e::admitted;
+		}
+		out_ticket = enqueueLocked(session_id);
+		return (INVALID_TICKET == out_ticket) ? admission_result_e::rejected : admission_result_e::queued;
+	}
+
+	/// 대기표 발행, 대기열이 가득 찬 경우 INVALID_TICKET
+	uint64_t enqueue(uint64_t session_id)
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		return enqueueLocked(session_id);
+	}
+
+	bool cancel(uint64_t ticket)
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		entry_t *entry = findWaiting(ticket);
+		if (!entry)
+		{
+			return false;
+		}
+
+		entry->m_state = entry_state_e::cancelled;
+		addCancelled(ticket & m_ring_mask, 1);
+		--m_waiting_count;
+		return true;
+	}
+
+	/// 1부터 시작하는 순번, 대기중이 아니면 0
+	int32_t position(uint64_t ticket)
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		if (!findWaiting(ticket))
+		{
+			return 0;
+		}
+		return positionOf(ticket);
+	}
+
+	int32_t waitingCount() const
+	{
+		return m_waiting_count;
+	}
+
+	float admitCredit() const
+	{
+		return m_admit_credit;
+	}
+
+public:
+	/**
+	입장 허용, busy 평균값이 fatal에 가까울수록 허용 속도를 줄이고 게임서버 여유 인원을 넘지 않는다.
+	elapsed_sec : 이전 호출 이후 경과 시간
+	*/
+	int32_t drain(const BusyLevel &busy_level, int32_t server_headroom, float elapsed_sec, _out std::vector<uint64_t> &admitted_session_ids)
+	{
+		return drain(busy_level.currentBusyLevel(), loadRatio(busy_level), server_headroom, elapsed_sec, admitted_session_ids);
+	}
+
+	/// 합쳐진 단계로 입장 가능 여부를, 원인 자원의 평균값으로 허용 속도를 정한다.
+	int32_t drain(const CompositeBusyLevel &composite_busy_level, int32_t server_headroom, float elapsed_sec, _out std::vector<uint64_t> &admitted_session_ids)
+	{
+		const BusyLevel &busy_level = composite_busy_level.resourceBusyLevel(composite_busy_level.responsibleResource());
+		return drain(composite_busy_level.currentBusyLevel(), loadRatio(busy_level), server_headroom, elapsed_sec, admitted_session_ids);
+	}
+
+	/// load_ratio : fatal 기준 대비 부하(0~1)
+	int32_t drain(BusyLevel_e::TYPE busy_level, float load_ratio, int32_t server_headroom, float elapsed_sec, _out std::vector<uint64_t> &admitted_session_ids)
+	{
+		admitted_session_ids.clear();
+
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		float admit_rate = m_max_admit_per_sec * std::max(0.0f, std::min(1.0f, 1.0f - load_ratio));
+
+		// 입장제한(BUSY_WARN 미만)이거나 허용 속도가 0이면 쌓아둔 허용량도 버린다.
+		if (busy_level < BusyLevel_e::BUSY_WARN || admit_rate <= 0.0f)
+		{
+			m_admit_credit = 0.0f;
+			return 0;
+		}
+
+		// 허용량을 누적해두었다가 정수만큼 사용한다. 1초 이상은 쌓아두지 않는다.
+		m_admit_credit = std::min(m_admit_credit + admit_rate * elapsed_sec, std::max(admit_rate, 1.0f));
+		int32_t admit_count = std::min(static_cast<int32_t>(m_admit_credit), std::max(server_headroom, 0));
+		if (admit_count <= 0)
+		{
+			return 0;
+		}
+
+		while (m_head_ticket < m_tail_ticket && static_cast<int32_t>(admitted_session_ids.size()) < admit_count)
+		{
+			uint32_t index = m_head_ticket & m_ring_mask;
+			entry_t &entry = m_entries[index];
+			if (entry_state_e::cancelled == entry.m_state)
+			{
+				addCancelled(index, -1);
+			}
+			else
+			{
+				admitted_session_ids.push_back(entry.m_session_id);
+				--m_waiting_count;
+			}
+			entry.m_state = entry_state_e::empty;
+			++m_head_ticket;
+		}
+
+		m_admit_credit -= static_cast<float>(admitted_session_ids.size());
+		return static_cast<int32_t>(admitted_session_ids.size());
+	}
+
+	/**
+	순번 알림 대상 수집, 지난 알림 이후 순번 변화가 m_position_step 이상인 대기자만 모은다.
+	호출마다 이전에 멈춘 위치부터 최대 max_count 만큼 돌려주므로 대기자가 많아도 알림량이 일정하다.
+	*/
+	void collectPositionUpdates(int32_t max_count, _out std::vector<position_update_t> &updates)
+	{
+		updates.clear();
+
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		if (m_position_cursor < m_head_ticket || m_position_cursor >= m_tail_ticket)
+		{
+			m_position_cursor = m_head_ticket;
+		}
+		if (m_position_cursor >= m_tail_ticket)
+		{
+			return;
+		}
+
+		int32_t running_position = positionOf(m_position_cursor);
+		uint64_t scan_limit = static_cast<uint64_t>(max_count) * 4; // 알림 대상이 적어도 한번에 너무 많이 보지 않는다.
+		for (uint64_t scanned = 0; m_position_cursor < m_tail_ticket && scanned < scan_limit; ++scanned, ++m_position_cursor)
+		{
+			entry_t &entry = m_entries[m_position_cursor & m_ring_mask];
+			if (entry_state_e::waiting != entry.m_state)
+			{
+				continue;
+			}
+
+			if (0 == entry.m_notified_position || entry.m_notified_position - running_position >= m_position_step)
+			{
+				entry.m_notified_position = running_position;
+				updates.push_back(position_update_t{entry.m_session_id, entry.m_ticket, running_position});
+				if (static_cast<int32_t>(updates.size()) >= max_count)
+				{
+					++m_position_cursor;
+					break;
+				}
+			}
+			++running_position;
+		}
+	}
+
+private:
+	// m_mutex 잠근 상태에서 호출
+	uint64_t enqueueLocked(uint64_t session_id)
+	{
+		if (m_tail_ticket - m_head_ticket >= m_ring_size)
+		{
+			LOG_WARN("admission queue full. session_id:{0} waiting_count:{1}", session_id, m_waiting_count);
+			return INVALID_TICKET;
+		}
+
+		uint64_t ticket = m_tail_ticket++;
+		entry_t &entry = m_entries[ticket & m_ring_mask];
+		entry.m_session_id = session_id;
+		entry.m_ticket = ticket;
+		entry.m_state = entry_state_e::waiting;
+		entry.m_notified_position = 0;
+
+		++m_waiting_count;
+		return ticket;
+	}
+
+	static float loadRatio(const BusyLevel &busy_level)
+	{
+		float busy_fatal = busy_level.busyValue(BusyLevel_e::BUSY_FATAL);
+		return (busy_fatal > 0.0f) ? busy_level.recentAverageValue() / busy_fatal : 0.0f;
+	}
+
+	struct entry_state_e
+	{
+		enum type : uint8_t
+		{
+			empty,
+			waiting,
+			cancelled
+		};
+	};
+
+	struct entry_t
+	{
+		uint64_t m_session_id{0};
+		uint64_t m_ticket{0};
+		entry_state_e::type m_state{entry_state_e::empty};
+		int32_t m_notified_position{0};
+	};
+
+	entry_t *findWaiting(uint64_t ticket)
+	{
+		if (ticket < m_head_ticket || ticket >= m_tail_ticket)
+		{
+			return nullptr;
+		}
+		entry_t &entry = m_entries[ticket & m_ring_mask];
+		if (entry.m_ticket != ticket || entry_state_e::waiting != entry.m_state)
+		{
+			return nullptr;
+		}
+		return &entry;
+	}
+
+	int32_t positionOf(uint64_t ticket)
+	{
+		uint64_t ahead = ticket - m_head_ticket;
+		return static_cast<int32_t>(ahead - cancelledBetween(m_head_ticket, ticket)) + 1;
+	}
+
+	// fenwick tree : ring index 기준 취소 수
+	void addCancelled(uint32_t index, int32_t delta)
+	{
+		for (uint32_t node = index + 1; node <= m_ring_size; node += node & (~node + 1))
+		{
+			m_cancelled_tree[node] += delta;
+		}
+	}
+
+	int32_t cancelledPrefix(uint32_t end_index) const
+	{
+		int32_t sum = 0;
+		for (uint32_t node = end_index; node > 0; node -= node & (~node + 1))
+		{
+			sum += m_cancelled_tree[node];
+		}
+		return sum;
+	}
+
+	/// [from_ticket, to_ticket) 구간의 취소 수
+	int32_t cancelledBetween(uint64_t from_ticket, uint64_t to_ticket) const
+	{
+		if (to_ticket <= from_ticket)
+		{
+			return 0;
+		}
+		uint32_t from_index = from_ticket & m_ring_mask;
+		uint32_t to_index = to_ticket & m_ring_mask;
+		if (from_index < to_index)
+		{
+			return cancelledPrefix(to_index) - cancelledPrefix(from_index);
+		}
+		return cancelledPrefix(m_ring_size) - cancelledPrefix(from_index) + cancelledPrefix(to_index);
+	}
+
+private:
+	uint32_t m_ring_size{0};
+	uint32_t m_ring_mask{0};
+	std::vector<entry_t> m_entries;
+	std::vector<int32_t> m_cancelled_tree;
+
+	uint64_t m_head_ticket{0};
+	uint64_t m_tail_ticket{0};
+	uint64_t m_position_cursor{0};
+	int32_t m_waiting_count{0};
+
+	float m_max_admit_per_sec{100.0f};
+	float m_admit_credit{0.0f};
+	int32_t m_position_step{10};
+	std::atomic<const CompositeBusyLevel *> m_busy_level_source{nullptr};
+
+	spin_mutex_t m_mutex;
+};
@@ -0,0 +1,358 @@
+//
+
+#include "preheader.h"
+
+#include "AsyncLogSink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+/// writer 스레드가 로거 이름마다 하나씩 만들어 동기 로그와 같은 경로로 기록한다.
+/// 한번 비울 때 모은 줄을 버퍼 하나로 만들어 가장 높은 단계로 한번만 기록한다.
+class AsyncLogSink::logger_writer_t
+	: public LoggerBaseInfo
+{
+public:
+	explicit logger_writer_t(const string_t &logger_name)
+	{
+		setDefaultLoggerName(logger_name);
+	}
+
+	bool empty() const
+	{
+		return m_buffer.empty();
+	}
+
+	/// 줄 머리("[단계] NDC ")를 붙이고 메시지를 이어 쓸 버퍼를 돌려준다.
+	string_t &beginLine(async_log_level_e::TYPE level, const boost::shared_ptr<const string_t> &ndc)
+	{
+		if (!m_buffer.empty())
+		{
+			m_buffer += '\n';
+		}
+		m_level = std::max(m_level, level);
+		m_buffer += '[';
+		m_buffer += async_log_level_e::ToString(level);
+		m_buffer += "] ";
+		if (ndc && !ndc->empty())
+		{
+			m_buffer += *ndc;
+			m_buffer += ' ';
+		}
+		return m_buffer;
+	}
+
+	void flush()
+	{
+		if (m_buffer.empty())
+		{
+			return;
+		}
+		switch (m_level)
+		{
+		case async_log_level_e::trace: LOG_TRACE("{0}", m_buffer); break;
+		case async_log_level_e::debug: LOG_DEBUG("{0}", m_buffer); break;
+		case async_log_level_e::info: LOG_INFO("{0}", m_buffer); break;
+		case async_log_level_e::warn: LOG_WARN("{0}", m_buffer); break;
+		default: LOG_ERROR("{0}", m_buffer); break;
+		}
+		// 버퍼 용량은 남겨서 다음 drain에서 다시 할당하지 않는다.
+		m_buffer.clear();
+		m_level = async_log_level_e::trace;
+	}
+
+private:
+	string_t m_buffer;
+	async_log_level_e::TYPE m_level{async_log_level_e::trace};
+};
+
+AsyncLogSink::AsyncLogSink()
+{
+	// log는 잠금 없이 format/logger 정보를 읽으므로 재할당이 없도록 미리 잡아둔다.
+	m_loggers.reserve(MAX_LOGGER_COUNT);
+	m_formats.reserve(MAX_FORMAT_COUNT);
+	m_loggers.push_back(new logger_info_t);
+	registerFormat("async.log", async_log_level_e::error, "async log format table full");
+}
+
+gplat::Result AsyncLogSink::start()
+{
+	gplat::Result gen_result;
+	if (m_running.exchange(true))
+	{
+		return gen_result.setFail("async log already started");
+	}
+
+	m_thread = std::thread([this]() { run(); });
+	return gen_result.setOk();
+}
+
+void AsyncLogSink::stop()
+{
+	if (!m_running.exchange(false))
+	{
+		return;
+	}
+
+	// writer가 push 중인 스레드를 기다린 후 남은 기록을 모두 쓰고 끝난다.
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+void AsyncLogSink::setOverflowPolicy(const string_t &logger_name, async_log_overflow_e::TYPE overflow_policy)
+{
+	std::lock_guard<std::mutex> lock(m_loggers_mutex);
+	uint32_t logger_id = findOrAddLogger(logger_name);
+	if (0 != logger_id)
+	{
+		m_loggers[logger_id]->m_overflow_policy.store(overflow_policy, std::memory_order_relaxed);
+	}
+}
+
+void AsyncLogSink::setLevel(const string_t &logger_name, async_log_level_e::TYPE level)
+{
+	std::lock_guard<std::mutex> lock(m_loggers_mutex);
+	uint32_t logger_id = findOrAddLogger(logger_name);
+	if (0 != logger_id)
+	{
+		m_loggers[logger_id]->m_level_set = true;
+		m_loggers[logger_id]->m_level.store(level, std::memory_order_relaxed);
+	}
+}
+
+void AsyncLogSink::setDefaultLevel(async_log_level_e::TYPE level)
+{
+	std::lock_guard<std::mutex> lock(m_loggers_mutex);
+	m_default_level.store(level, std::memory_order_relaxed);
+	for (auto logger_info : m_loggers)
+	{
+		if (!logger_info->m_level_set)
+		{
+			logger_info->m_level.store(level, std::memory_order_relaxed);
+		}
+	}
+}
+
+uint32_t AsyncLogSink::registerLogger(const string_t &logger_name)
+{
+	std::lock_guard<std::mutex> lock(m_loggers_mutex);
+	return findOrAddLogger(logger_name);
+}
+
+uint32_t AsyncLogSink::findOrAddLogger(const string_t &logger_name)
+{
+	auto it = m_logger_ids.find(logger_name);
+	if (it != m_logger_ids.end())
+	{
+		return it->second;
+	}
+	if (logger_name.empty() || m_loggers.size() >= MAX_LOGGER_COUNT)
+	{
+		return 0;
+	}
+
+	auto logger_info = new logger_info_t;
+	logger_info->m_logger_name = logger_name;
+	logger_info->m_level.store(m_default_level.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	m_loggers.push_back(logger_info);
+
+	uint32_t logger_id = static_cast<uint32_t>(m_loggers.size() - 1);
+	m_logger_ids[logger_name] = logger_id;
+	return logger_id;
+}
+
+uint32_t AsyncLogSink::registerFormat(const char *logger_name, async_log_level_e::TYPE level, const char *format)
+{
+	std::lock_guard<std::mutex> lock(m_loggers_mutex);
+	if (m_formats.size() >= MAX_FORMAT_COUNT)
+	{
+		return 0;
+	}
+
+	auto format_info = new format_info_t;
+	format_info->m_logger_id = findOrAddLogger(logger_name);
+	format_info->m_level = level;
+	format_info->m_format = format;
+
+	m_formats.push_back(format_info);
+	return static_cast<uint32_t>(m_formats.size() - 1);
+}
+
+uint64_t AsyncLogSink::dropCount(const string_t &logger_name)
+{
+	std::lock_guard<std::mutex> lock(m_loggers_mutex);
+	auto it = m_logger_ids.find(logger_name);
+	if (it == m_logger_ids.end())
+	{
+		return 0;
+	}
+	return m_loggers[it->second]->m_drop_count.load(std::memory_order_relaxed);
+}
+
+AsyncLogSink::thread_ring_t *AsyncLogSink::createRing()
+{
+	auto thread_ring = new thread_ring_t;
+	std::lock_guard<std::mutex> lock(m_rings_mutex);
+	m_rings.push_back(thread_ring);
+	return thread_ring;
+}
+
+AsyncLogSink::record_t *AsyncLogSink::reserve(thread_ring_t &thread_ring, logger_info_t *logger_info)
+{
+	uint64_t tail = thread_ring.m_tail.load(std::memory_order_relaxed);
+	while (tail - thread_ring.m_head.load(std::memory_order_acquire) >= RING_SIZE)
+	{
+		// 중지 중이면 writer가 이 스레드를 기다리고 있으므로 막지 않는다.
+		if (async_log_overflow_e::drop == logger_info->m_overflow_policy.load(std::memory_order_relaxed) || !isRunning())
+		{
+			logger_info->m_drop_count.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		std::this_thread::yield();
+	}
+	return &thread_ring.m_records[tail & (RING_SIZE - 1)];
+}
+
+void AsyncLogSink::appendRecord(const record_t &record, _out string_t &buffer)
+{
+	const format_info_t *format_info = m_formats[record.m_format_id];
+
+	// {} 는 순서대로, {n} 은 n번째 인자로 치환한다.
+	const string_t &format = format_info->m_format;
+	uint32_t next_arg = 0;
+	for (size_t pos = 0; pos < format.size(); ++pos)
+	{
+		if ('{' == format[pos])
+		{
+			size_t close = format.find('}', pos);
+			if (close != string_t::npos)
+			{
+				uint32_t arg_index = next_arg;
+				if (close > pos + 1)
+				{
+					arg_index = static_cast<uint32_t>(std::strtoul(format.c_str() + pos + 1, nullptr, 10));
+				}
+				++next_arg;
+
+				if (arg_index < record.m_arg_count)
+				{
+					char arg_buffer[32];
+					switch (record.m_arg_types[arg_index])
+					{
+					case arg_type_e::int_type:
+						snprintf(arg_buffer, sizeof(arg_buffer), "%lld", static_cast<long long>(record.m_args[arg_index].m_int));
+						break;
+					case arg_type_e::uint_type:
+						snprintf(arg_buffer, sizeof(arg_buffer), "%llu", static_cast<unsigned long long>(record.m_args[arg_index].m_uint));
+						break;
+					default:
+						snprintf(arg_buffer, sizeof(arg_buffer), "%g", record.m_args[arg_index].m_double);
+						break;
+					}
+					buffer += arg_buffer;
+				}
+				pos = close;
+				continue;
+			}
+		}
+		buffer += format[pos];
+	}
+}
+
+bool AsyncLogSink::drain(thread_ring_t &thread_ring)
+{
+	uint64_t head = thread_ring.m_head.load(std::memory_order_relaxed);
+	uint64_t tail = thread_ring.m_tail.load(std::memory_order_acquire);
+	if (head == tail)
+	{
+		return false;
+	}
+
+	for (; head < tail; ++head)
+	{
+		record_t &record = thread_ring.m_records[head & (RING_SIZE - 1)];
+		logger_info_t *logger_info = m_loggers[record.m_logger_id];
+		if (!logger_info->m_writer)
+		{
+			logger_info->m_writer = new logger_writer_t(logger_info->m_logger_name);
+		}
+
+		if (logger_info->m_writer->empty())
+		{
+			m_pending_writers.push_back(logger_info->m_writer);
+		}
+		appendRecord(record, logger_info->m_writer->beginLine(m_formats[record.m_format_id]->m_level, record.m_ndc));
+		record.m_ndc.reset();
+	}
+	thread_ring.m_head.store(head, std::memory_order_release);
+	return true;
+}
+
+void AsyncLogSink::flush()
+{
+	for (auto writer : m_pending_writers)
+	{
+		writer->flush();
+	}
+	m_pending_writers.clear();
+}
+
+void AsyncLogSink::waitPushing(const std::vector<thread_ring_t *> &rings)
+{
+	for (auto thread_ring : rings)
+	{
+		while (thread_ring->m_pushing.load(std::memory_order_seq_cst))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void AsyncLogSink::run()
+{
+	std::vector<thread_ring_t *> rings;
+
+	while (true)
+	{
+		bool running = m_running.load(std::memory_order_seq_cst);
+		{
+			std::lock_guard<std::mutex> lock(m_rings_mutex);
+			rings = m_rings;
+		}
+
+		// 중지 후에는 push 중이던 기록까지 모두 들어온 다음 마지막으로 비운다.
+		if (!running)
+		{
+			waitPushing(rings);
+		}
+
+		bool written = false;
+		for (auto thread_ring : rings)
+		{
+			// 종료 표시를 먼저 읽어야 그 이전의 기록을 모두 비운 뒤 해제할 수 있다.
+			bool retired = thread_ring->m_retired.load(std::memory_order_acquire);
+			written |= drain(*thread_ring);
+			if (retired)
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_rings_mutex);
+					m_rings.erase(std::find(m_rings.begin(), m_rings.end(), thread_ring));
+				}
+				delete thread_ring;
+			}
+		}
+		flush();
+
+		if (!running)
+		{
+			break;
+		}
+		if (!written)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
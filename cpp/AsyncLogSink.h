@@ -0,0 +1,315 @@
+//
+#pragma once
+
+#include "Concurrency.h"
+#include <atomic>
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct async_log_level_e
+{
+	enum TYPE : uint8_t
+	{
+		trace,
+		debug,
+		info,
+		warn,
+		error
+	};
+
+	static const char *ToString(TYPE type)
+	{
+		switch (type)
+		{
+		case trace: return "TRACE";
+		case debug: return "DEBUG";
+		case info: return "INFO";
+		case warn: return "WARN";
+		case error: return "ERROR";
+		}
+		return "UNKNOWN";
+	}
+};
+
+/// 스레드 ring이 가득 찼을 때 처리 방식, 로거 이름 단위로 지정
+struct async_log_overflow_e
+{
+	enum TYPE : uint8_t
+	{
+		drop, // 버리고 drop 카운트 증가
+		block // 자리가 날 때까지 대기
+	};
+};
+
+/// 호출한 객체의 로거와 NDC, 객체가 없으면 포맷 등록시의 로거 이름을 쓴다.
+struct async_log_context_t
+{
+	uint32_t m_logger_id{0};
+	boost::shared_ptr<const string_t> m_ndc;
+};
+
+/// 멤버 asyncLogContext()가 없는 곳에서 ASYNC_LOG_* 매크로가 사용한다.
+inline async_log_context_t asyncLogContext()
+{
+	return async_log_context_t();
+}
+
+/**
+세션/네트워크 경로용 비동기 로그
+- 호출 위치마다 포맷 문자열을 한번 등록하고 (format id + 로거 id + NDC + 숫자 인자)만 스레드별 ring에 넣는다.
+- 로거별 단계(setLevel)보다 낮은 기록은 ring에 넣기 전에 버린다. 인자도 계산하지 않는다.
+- writer 스레드가 로거별 버퍼에 "[단계] NDC 메시지" 줄로 모아서 한번 비울 때마다 같은 이름의 로거로 LOG_* 를 한번만 호출한다.
+- ring은 스레드별 단일 생산자/단일 소비자이므로 잠금이 없다.
+- start 전이나 stop 이후에는 ASYNC_LOG_* 매크로가 기존 LOG_* 로 그대로 기록한다.
+- stop은 push 중인 스레드가 끝나기를 기다린 후 남은 기록을 모두 쓰고 돌아온다.
+*/
+class AsyncLogSink
+{
+public:
+	static const uint32_t MAX_ARG_COUNT = 6;
+	static const uint32_t RING_SIZE = 4096; ///< 2의 거듭제곱
+	static const uint32_t MAX_FORMAT_COUNT = 4096;
+	static const uint32_t MAX_LOGGER_COUNT = 1024;
+
+	static AsyncLogSink &instance()
+	{
+		static AsyncLogSink s_instance;
+		return s_instance;
+	}
+
+public:
+	gplat::Result start();
+	void stop();
+
+	bool isRunning() const
+	{
+		return m_running.load(std::memory_order_relaxed);
+	}
+
+	/// 로거별 overflow 방식 지정
+	void setOverflowPolicy(const string_t &logger_name, async_log_overflow_e::TYPE overflow_policy);
+
+	/// 로거별 최소 단계, 설정하지 않은 로거는 기본 단계(setDefaultLevel, 처음은 info)를 쓴다.
+	void setLevel(const string_t &logger_name, async_log_level_e::TYPE level);
+	void setDefaultLevel(async_log_level_e::TYPE level);
+
+	/// 로거 이름 -> id, 세션처럼 로거 이름을 생성시 받는 객체가 한번 등록해 둔다.
+	uint32_t registerLogger(const string_t &logger_name);
+
+	uint32_t registerFormat(const char *logger_name, async_log_level_e::TYPE level, const char *format);
+
+	uint64_t dropCount(const string_t &logger_name);
+
+public:
+	/// 기록할 로거의 단계 이상인지, 등록 후 정보가 변하지 않으므로 잠금 없이 읽는다.
+	bool isEnabled(uint32_t format_id, const async_log_context_t &context) const
+	{
+		const format_info_t *format_info = m_formats[format_id];
+		uint32_t logger_id = (0 != context.m_logger_id) ? context.m_logger_id : format_info->m_logger_id;
+		return format_info->m_level >= m_loggers[logger_id]->m_level.load(std::memory_order_relaxed);
+	}
+
+	/// 실행 중이 아니면 false, 호출한 쪽에서 동기 로그로 남긴다.
+	template <typename... ARGS>
+	bool log(uint32_t format_id, const async_log_context_t &context, ARGS... args)
+	{
+		static_assert(sizeof...(ARGS) <= MAX_ARG_COUNT, "too many async log arguments");
+
+		thread_ring_t &thread_ring = ring();
+
+		// stop이 이 표시를 보고 기다리므로 표시 후에 실행 여부를 다시 확인한다.
+		thread_ring.m_pushing.store(true, std::memory_order_seq_cst);
+		if (!m_running.load(std::memory_order_seq_cst))
+		{
+			thread_ring.m_pushing.store(false, std::memory_order_release);
+			return false;
+		}
+
+		// 등록 후 format/logger 정보는 변하지 않으므로 잠금 없이 읽는다.
+		uint32_t logger_id = (0 != context.m_logger_id) ? context.m_logger_id : m_formats[format_id]->m_logger_id;
+		record_t *record = reserve(thread_ring, m_loggers[logger_id]);
+		if (record)
+		{
+			record->m_format_id = format_id;
+			record->m_logger_id = logger_id;
+			record->m_arg_count = 0;
+			record->m_ndc = context.m_ndc;
+			pushArgs(*record, args...);
+			thread_ring.m_tail.store(thread_ring.m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		thread_ring.m_pushing.store(false, std::memory_order_release);
+		return true;
+	}
+
+private:
+	struct arg_type_e
+	{
+		enum TYPE : uint8_t
+		{
+			int_type,
+			uint_type,
+			double_type
+		};
+	};
+
+	struct record_t
+	{
+		uint32_t m_format_id;
+		uint32_t m_logger_id;
+		uint8_t m_arg_count;
+		uint8_t m_arg_types[MAX_ARG_COUNT];
+		union
+		{
+			int64_t m_int;
+			uint64_t m_uint;
+			double m_double;
+		} m_args[MAX_ARG_COUNT];
+		boost::shared_ptr<const string_t> m_ndc; ///< writer가 쓴 후 비운다.
+	};
+
+	struct thread_ring_t
+	{
+		record_t m_records[RING_SIZE];
+		std::atomic<uint64_t> m_head{0}; ///< writer가 증가
+		std::atomic<uint64_t> m_tail{0}; ///< 생산 스레드가 증가
+		std::atomic<bool> m_pushing{false};
+		std::atomic<bool> m_retired{false}; ///< 스레드 종료, writer가 비운 후 해제한다.
+	};
+
+	/// 스레드 종료시 ring을 writer에게 넘긴다.
+	struct ring_holder_t
+	{
+		thread_ring_t *m_ring{nullptr};
+
+		~ring_holder_t()
+		{
+			if (m_ring)
+			{
+				m_ring->m_retired.store(true, std::memory_order_release);
+				m_ring = nullptr;
+			}
+		}
+	};
+
+	class logger_writer_t;
+
+	struct logger_info_t
+	{
+		string_t m_logger_name;
+		std::atomic<uint8_t> m_overflow_policy{async_log_overflow_e::drop};
+		std::atomic<uint8_t> m_level{async_log_level_e::info};
+		bool m_level_set{false}; ///< setLevel로 지정했으면 기본 단계를 따르지 않는다. m_loggers_mutex로 보호
+		std::atomic<uint64_t> m_drop_count{0};
+		logger_writer_t *m_writer{nullptr}; ///< writer 스레드만 사용
+	};
+
+	struct format_info_t
+	{
+		uint32_t m_logger_id;
+		async_log_level_e::TYPE m_level;
+		string_t m_format;
+	};
+
+private:
+	AsyncLogSink();
+	~AsyncLogSink()
+	{
+		stop();
+	}
+
+	void pushArgs(record_t &)
+	{
+	}
+
+	template <typename T, typename... REST>
+	void pushArgs(record_t &record, T value, REST... rest)
+	{
+		static_assert(std::is_arithmetic<T>::value, "async log argument should be numeric");
+		uint8_t index = record.m_arg_count++;
+		if (std::is_floating_point<T>::value)
+		{
+			record.m_arg_types[index] = arg_type_e::double_type;
+			record.m_args[index].m_double = static_cast<double>(value);
+		}
+		else if (std::is_signed<T>::value)
+		{
+			record.m_arg_types[index] = arg_type_e::int_type;
+			record.m_args[index].m_int = static_cast<int64_t>(value);
+		}
+		else
+		{
+			record.m_arg_types[index] = arg_type_e::uint_type;
+			record.m_args[index].m_uint = static_cast<uint64_t>(value);
+		}
+		pushArgs(record, rest...);
+	}
+
+	/// 빈 자리를 돌려준다. overflow 방식에 따라 버리면 nullptr
+	record_t *reserve(thread_ring_t &thread_ring, logger_info_t *logger_info);
+
+	thread_ring_t &ring()
+	{
+		static thread_local ring_holder_t s_ring_holder;
+		if (!s_ring_holder.m_ring)
+		{
+			s_ring_holder.m_ring = createRing();
+		}
+		return *s_ring_holder.m_ring;
+	}
+
+	thread_ring_t *createRing();
+
+	// m_loggers_mutex 잠근 상태에서 호출
+	uint32_t findOrAddLogger(const string_t &logger_name);
+
+	void run();
+	void waitPushing(const std::vector<thread_ring_t *> &rings);
+	bool drain(thread_ring_t &thread_ring);
+	void flush();
+	void appendRecord(const record_t &record, _out string_t &buffer);
+
+private:
+	std::atomic<bool> m_running{false};
+	std::thread m_thread;
+
+	std::mutex m_rings_mutex;
+	std::vector<thread_ring_t *> m_rings; ///< 종료된 스레드의 ring은 writer가 비운 후 해제한다.
+
+	std::mutex m_loggers_mutex;
+	std::vector<logger_info_t *> m_loggers; ///< logger id -> 정보, 등록후 해제하지 않는다. 0번은 비어있음
+	std::map<string_t, uint32_t> m_logger_ids;
+	std::atomic<uint8_t> m_default_level{async_log_level_e::info};
+	std::vector<format_info_t *> m_formats; ///< format id -> 정보, 등록후 변하지 않는다. 0번은 가득 찬 경우 사용
+
+	std::vector<logger_writer_t *> m_pending_writers; ///< 이번 drain에서 버퍼에 쓴 writer, writer 스레드만 사용
+};
+
+#define ASYNC_LOG_IMPL(LEVEL, SYNC_LOG, LOGGER_NAME, FORMAT, ...)                                                                      \
+	do                                                                                                                                 \
+	{                                                                                                                                  \
+		if (AsyncLogSink::instance().isRunning())                                                                                      \
+		{                                                                                                                              \
+			static const uint32_t s_async_log_format_id = AsyncLogSink::instance().registerFormat(LOGGER_NAME, LEVEL, FORMAT);       \
+			const async_log_context_t async_log_context = asyncLogContext();                                                           \
+			if (!AsyncLogSink::instance().isEnabled(s_async_log_format_id, async_log_context))                                         \
+			{                                                                                                                          \
+				break;                                                                                                                 \
+			}                                                                                                                          \
+			if (AsyncLogSink::instance().log(s_async_log_format_id, async_log_context, ##__VA_ARGS__))                                 \
+			{                                                                                                                          \
+				break;                                                                                                                 \
+			}                                                                                                                          \
+		}                                                                                                                              \
+		SYNC_LOG(FORMAT, ##__VA_ARGS__);                                                                                               \
+	} while (0)
+
+#define ASYNC_LOG_TRACE(LOGGER_NAME, FORMAT, ...) ASYNC_LOG_IMPL(async_log_level_e::trace, LOG_TRACE, LOGGER_NAME, FORMAT, ##__VA_ARGS__)
+#define ASYNC_LOG_DEBUG(LOGGER_NAME, FORMAT, ...) ASYNC_LOG_IMPL(async_log_level_e::debug, LOG_DEBUG, LOGGER_NAME, FORMAT, ##__VA_ARGS__)
+#define ASYNC_LOG_INFO(LOGGER_NAME, FORMAT, ...) ASYNC_LOG_IMPL(async_log_level_e::info, LOG_INFO, LOGGER_NAME, FORMAT, ##__VA_ARGS__)
+#define ASYNC_LOG_WARN(LOGGER_NAME, FORMAT, ...) ASYNC_LOG_IMPL(async_log_level_e::warn, LOG_WARN, LOGGER_NAME, FORMAT, ##__VA_ARGS__)
+#define ASYNC_LOG_ERROR(LOGGER_NAME, FORMAT, ...) ASYNC_LOG_IMPL(async_log_level_e::error, LOG_ERROR, LOGGER_NAME, FORMAT, ##__VA_ARGS__)
@@ -0,0 +1,42 @@
+//
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// 64bit 비트 연산, gcc/clang은 builtin, MSVC는 intrinsic을 사용한다.
+// countTrailingZero64, countLeadingZero64는 0이 아닌 값에만 사용한다.
+
+inline uint32_t popCount64(uint64_t value)
+{
+#if defined(_MSC_VER)
+	return static_cast<uint32_t>(__popcnt64(value));
+#else
+	return static_cast<uint32_t>(__builtin_popcountll(value));
+#endif
+}
+
+inline uint32_t countTrailingZero64(uint64_t value)
+{
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanForward64(&index, value);
+	return static_cast<uint32_t>(index);
+#else
+	return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+inline uint32_t countLeadingZero64(uint64_t value)
+{
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanReverse64(&index, value);
+	return static_cast<uint32_t>(63 - index);
+#else
+	return static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
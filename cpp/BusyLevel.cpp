@@ -3,6 +3,7 @@
 #include "preheader.h"
 
 #include "BusyLevel.h"
+#include "MetricsRegistry.h"
 #include <libGen/cpp/log/Logger.h>
 
 #include <boost/chrono/chrono.hpp>
@@ -39,6 +40,13 @@ void BusyLevel::setup(const BusyLevelParam &busyLevelParam, const string_t &logg
 	if (!loggerName.empty())
 	{
 		setDefaultLoggerName(loggerName);
+		m_async_logger_id = AsyncLogSink::instance().registerLogger(loggerName);
+	}
+
+	// 지표는 인스턴스당 처음 setup에서 한번만 등록한다.
+	if (MetricsRegistry::INVALID_METRIC_ID == m_average_metric_id)
+	{
+		registerMetrics(loggerName.empty() ? string_t("monitor.busylevel") : loggerName);
 	}
 
 	setSampleCount(busyLevelParam.m_sampleCount);
@@ -56,9 +64,16 @@ void BusyLevel::setup(const BusyLevelParam &busyLevelParam, const string_t &logg
 
 	m_use_session_action = busyLevelParam.m_useSessionAction;
 	m_use_fatal_action = busyLevelParam.m_useFatalAction;
+
+	setTransition(busyLevelParam.m_minDwell, busyLevelParam.m_minTransitionInterval, busyLevelParam.m_stepRecovery);
 }
 
 bool BusyLevel::decide(float aValue, const string_t &callerName, uint16_t sliceCount /*= 0*/)
+{
+	return decideAt(aValue, callerName, sliceCount, clock_t::now());
+}
+
+bool BusyLevel::decideAt(float aValue, const string_t &callerName, uint16_t sliceCount, const timePoint_t &now)
 {
 	if (!isValid())
 	{
@@ -66,30 +81,27 @@ bool BusyLevel::decide(float aValue, const string_t &callerName, uint16_t sliceC
 		return false;
 	}
 
-	float totalValue = 0;
 	float averageValue = 0;
 	{
+		// 최근 m_sample_count개의 합을 유지하여 샘플 하나당 비용을 일정하게 한다.
 		spin_mutex_t::scoped_lock lock(m_datas_mutex);
-		m_datas.push_back(aValue);
-
-		int32_t dataListSize = static_cast<int32_t>(m_datas.size());
-		if (dataListSize == m_sample_count + 1)
+		if (m_datas.size() != static_cast<size_t>(m_sample_count))
 		{
-			m_datas.pop_front();
+			m_datas.assign(m_sample_count, 0.0f);
+			m_data_index = 0;
+			m_data_total = 0.0;
 		}
 
-		int32_t maxDataCount = dataListSize > m_sample_count ? dataListSize : m_sample_count; ///< 데이터가 다 차지 않았을 경우
-		for (auto &value : m_datas)
-		{
-			totalValue += value;
-		}
+		m_data_total += aValue - m_datas[m_data_index];
+		m_datas[m_data_index] = aValue;
+		m_data_index = (m_data_index + 1) % m_sample_count;
 
-		m_recent_average_value = averageValue = totalValue / m_sample_count;
+		m_recent_average_value = averageValue = static_cast<float>(m_data_total / m_sample_count);
 	}
 
 	if (m_useLog)
 	{
-		timePoint_t start_time_point = clock_t::now();
+		timePoint_t start_time_point = now;
 		timePoint_t::duration diff = start_time_point - m_last_time_point;
 		float duration = static_cast<float>(diff.count());
 
@@ -99,7 +111,6 @@ bool BusyLevel::decide(float aValue, const string_t &callerName, uint16_t sliceC
 
 			// NAMED_INFO("monitor.busyvalue", sformat("{0},{1},SliceCount:{2}", ffdot(averageValue, 0, 5), m_outlier, sliceCount));
 			// NAMED_INFO("monitor.busyvalue", sformat("{0},{1},SliceCount:{2}", averageValue, m_outlier, sliceCount));
-			NAMED_INFO("monitor.busyvalue", "{0},{1},SliceCount:{2}", averageValue, m_outlier, sliceCount);
 			m_outlier = 0.f;
 
 			m_last_time_point = start_time_point;
@@ -109,9 +120,9 @@ bool BusyLevel::decide(float aValue, const string_t &callerName, uint16_t sliceC
 	/// busy level 구간 : 100 < - very busy  - > 95 < - most busy - > 80 < - busy - > 70 < - good - > 0
 	/// 복구 구간 : very busy -10%-> good, most busy -30%-> good, busy -50%-> good
 	float busyFatal = m_busyValue[BusyLevel_e::BUSY_FATAL];
-	float busyError = 0.0f;
-	float busyWarn = 0.0f;
-	float busyIdle = 0.0f;
+	float busyError = busyThreshold(BusyLevel_e::BUSY_ERROR);
+	float busyWarn = busyThreshold(BusyLevel_e::BUSY_WARN);
+	float busyIdle = busyThreshold(BusyLevel_e::BUSY_IDLE);
 
 	float busyFatalToIdle = 0.0f;
 	float busyErrorToIdle = 0.0f;
@@ -119,20 +130,12 @@ bool BusyLevel::decide(float aValue, const string_t &callerName, uint16_t sliceC
 
 	if (decide_method_e::PERCENT == m_decide_method)
 	{
-		busyError = busyFatal * m_busyValue[BusyLevel_e::BUSY_ERROR];
-		busyWarn = busyFatal * m_busyValue[BusyLevel_e::BUSY_WARN];
-		busyIdle = busyFatal * m_busyValue[BusyLevel_e::BUSY_IDLE];
-
 		busyFatalToIdle = busyFatal * m_toGoodValue[BusyLevel_e::BUSY_FATAL]; //이하로 떨어지면 정상복구 처리
 		busyErrorToIdle = busyFatal * m_toGoodValue[BusyLevel_e::BUSY_ERROR];
 		busyWarnToIdle = busyFatal * m_toGoodValue[BusyLevel_e::BUSY_WARN];
 	}
 	else
 	{
-		busyError = m_busyValue[BusyLevel_e::BUSY_ERROR];
-		busyWarn = m_busyValue[BusyLevel_e::BUSY_WARN];
-		busyIdle = m_busyValue[BusyLevel_e::BUSY_IDLE];
-
 		busyFatalToIdle = m_toGoodValue[BusyLevel_e::BUSY_FATAL]; //이하로 떨어지면 정상복구 처리
 		busyErrorToIdle = m_toGoodValue[BusyLevel_e::BUSY_ERROR];
 		busyWarnToIdle = m_toGoodValue[BusyLevel_e::BUSY_WARN];
@@ -140,72 +143,83 @@ bool BusyLevel::decide(float aValue, const string_t &callerName, uint16_t sliceC
 
 	BusyLevel_e::TYPE backupBusyLevel = m_current_busy_level;
 
-	switch (currentBusyLevel())
-	{
-	case BusyLevel_e::BUSY_IDLE:
+	/// 심각한 단계부터 나열, 진입값을 넘으면 해당 단계로 올라가고 복구값 이하이면 step_down(또는 IDLE)으로 내려온다.
+	const level_rule_t rules[] = {
+		{BusyLevel_e::BUSY_FATAL, BusyLevel_e::BUSY_ERROR, busyError, busyFatalToIdle},
+		{BusyLevel_e::BUSY_ERROR, BusyLevel_e::BUSY_WARN, busyWarn, busyErrorToIdle},
+		{BusyLevel_e::BUSY_WARN, BusyLevel_e::BUSY_IDLE, busyIdle, busyWarnToIdle},
+	};
+
+	BusyLevel_e::TYPE enterLevel = BusyLevel_e::BUSY_IDLE;
+	for (auto &rule : rules)
 	{
-		if (averageValue > busyError) ///
-		{
-			m_current_busy_level = BusyLevel_e::BUSY_FATAL;
-		}
-		else if (averageValue > busyWarn && averageValue <= busyError)
+		if (averageValue > rule.m_enter_value)
 		{
-			m_current_busy_level = BusyLevel_e::BUSY_ERROR;
-		}
-		else if (averageValue > busyIdle && averageValue <= busyWarn)
-		{
-			m_current_busy_level = BusyLevel_e::BUSY_WARN;
+			enterLevel = rule.m_level;
+			break;
 		}
 	}
-	break;
 
-	case BusyLevel_e::BUSY_WARN:
+	// 기록된 샘플을 재생하는 경우 생성 시각보다 이른 시각이 들어오므로 첫 샘플 시각부터 잰다.
+	if (!m_level_time_seeded)
 	{
-		if (averageValue > busyError) ///
-		{
-			m_current_busy_level = BusyLevel_e::BUSY_FATAL;
-		}
-		else if (averageValue > busyWarn && averageValue <= busyError)
-		{
-			m_current_busy_level = BusyLevel_e::BUSY_ERROR;
-		}
-		else if (averageValue <= busyWarnToIdle) /// 정상복귀
-		{
-			m_current_busy_level = BusyLevel_e::BUSY_IDLE;
-		}
+		m_level_time_point = now;
+		m_level_time_seeded = true;
 	}
-	break;
+	float levelDuration = static_cast<float>((now - m_level_time_point).count());
+	BusyLevel_e::TYPE nextLevel = m_current_busy_level;
 
-	case BusyLevel_e::BUSY_ERROR:
+	if (enterLevel < m_current_busy_level) /// 더 바뻐졌어 ㅠ..ㅠ (값이 작을수록 심각)
 	{
-		if (averageValue > busyError) /// 더 바뻐졌어 ㅠ..ㅠ
+		// FATAL은 바로 올리고 나머지는 전환 간격을 지킨다.
+		if (BusyLevel_e::BUSY_FATAL == enterLevel || levelDuration >= m_min_transition_interval)
 		{
-			m_current_busy_level = BusyLevel_e::BUSY_FATAL;
+			nextLevel = enterLevel;
 		}
-		else if (averageValue <= busyErrorToIdle) ///정상복귀
+	}
+	else
+	{
+		for (auto &rule : rules)
 		{
-			m_current_busy_level = BusyLevel_e::BUSY_IDLE;
+			if (rule.m_level != m_current_busy_level)
+			{
+				continue;
+			}
+
+			/// 정상복귀, 최소 유지시간이 지나야 내려온다.
+			if (averageValue <= rule.m_recover_value && levelDuration >= std::max(m_min_dwell, m_min_transition_interval))
+			{
+				nextLevel = m_step_recovery ? rule.m_step_down : BusyLevel_e::BUSY_IDLE;
+			}
+			break;
 		}
 	}
-	break;
 
-	case BusyLevel_e::BUSY_FATAL:
+	if (nextLevel != m_current_busy_level)
 	{
-		if (averageValue <= busyFatalToIdle) ///정상복귀
-		{
-			m_current_busy_level = BusyLevel_e::BUSY_IDLE;
-		}
+		m_current_busy_level = nextLevel;
+		m_level_time_point = now;
+		++m_transition_count;
+		MetricsRegistry::instance().addCounter(m_transition_metric_id);
+		ASYNC_LOG_INFO("monitor.busylevel", "busy level changed {0} -> {1} average:{2}", static_cast<int32_t>(backupBusyLevel), static_cast<int32_t>(nextLevel), averageValue);
 	}
-	break;
 
-	default:
-		break;
-	} // switch
+	MetricsRegistry::instance().setGauge(m_average_metric_id, averageValue);
+	MetricsRegistry::instance().setGauge(m_level_metric_id, static_cast<double>(m_current_busy_level));
 
 	// 처음의 상태값과 연산 이 후의 상태가 다르다면 변화가 있었으므로 true를 리턴해준다.
 	return (backupBusyLevel != m_current_busy_level);
 }
 
+void BusyLevel::registerMetrics(const string_t &loggerName)
+{
+	string_t labels = MetricsRegistry::instance().instanceLabels(loggerName);
+	auto &registry = MetricsRegistry::instance();
+	m_average_metric_id = registry.registerGauge("busylevel_average_value", labels);
+	m_level_metric_id = registry.registerGauge("busylevel_level", labels);
+	m_transition_metric_id = registry.registerCounter("busylevel_transition_total", labels);
+}
+
 void BusyLevel::setOutlier(float aValue)
 {
 	spin_mutex_t::scoped_lock lock(m_outlier_mutex);
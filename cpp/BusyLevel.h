@@ -4,7 +4,10 @@
 #pragma once
 
 #include "Concurrency.h"
+#include "AsyncLogSink.h"
+#include "MetricsRegistry.h"
 #include <boost/chrono.hpp>
+#include <vector>
 #include <libGen/cpp/log/LoggerBaseInfo.h>
 
 /**
@@ -74,6 +77,10 @@ struct BusyLevelParam
 
 		m_useSessionAction = false;
 		m_useFatalAction = false;
+
+		m_minDwell = 0.0f;
+		m_minTransitionInterval = 0.0f;
+		m_stepRecovery = false;
 	}
 
 	uchar_t m_decideType;
@@ -92,11 +99,15 @@ struct BusyLevelParam
 
 	bool m_useSessionAction;
 	bool m_useFatalAction;
+
+	float m_minDwell;			   ///< 복구(단계 하향)전 현재 단계 최소 유지시간(초)
+	float m_minTransitionInterval; ///< 단계 전환 최소 간격(초), FATAL 진입은 예외
+	bool m_stepRecovery;		   ///< FATAL->ERROR->WARN->IDLE 단계별 복구
 };
 
 
 /**
-busy level을 구간별로 결정하는 기능수행, 평균값 계산을 위해 데이터를 리스트로 유지한다.
+busy level을 구간별로 결정하는 기능수행, 평균값 계산을 위해 최근 데이터를 ring으로 유지한다.
 */
 class BusyLevel
 	: public LoggerBaseInfo
@@ -133,7 +144,16 @@ public:
 
 	void setSampleCount(int32_t sample_count)
 	{
-		m_sample_count = sample_count;
+		spin_mutex_t::scoped_lock lock(m_datas_mutex);
+		m_sample_count = std::max(sample_count, 1);
+	}
+
+	/// 단계 떨림 방지, 0이면 기존과 같이 바로 전환한다.
+	void setTransition(float min_dwell, float min_transition_interval, bool step_recovery)
+	{
+		m_min_dwell = min_dwell;
+		m_min_transition_interval = min_transition_interval;
+		m_step_recovery = step_recovery;
 	}
 
 	/// busylevel에서 good으로 돌아오기 위한 값
@@ -148,6 +168,21 @@ public:
 		m_busyValue[busylevel] = aValue;
 	}
 
+	float busyValue(BusyLevel_e::TYPE busylevel) const
+	{
+		return m_busyValue[busylevel];
+	}
+
+	/// 평균값과 비교하는 실제 기준값, PERCENT 방식이면 FATAL 값에 대한 비율을 곱해서 돌려준다.
+	float busyThreshold(BusyLevel_e::TYPE busylevel) const
+	{
+		if (decide_method_e::PERCENT == m_decide_method && BusyLevel_e::BUSY_FATAL != busylevel)
+		{
+			return m_busyValue[BusyLevel_e::BUSY_FATAL] * m_busyValue[busylevel];
+		}
+		return m_busyValue[busylevel];
+	}
+
 	/// FATAL은 반드시 제공되어야 하므로 없는 경우 세팅이 안되었다고 볼 수 있다. 
 
 	bool isValid() const
@@ -158,6 +193,15 @@ public:
 public:
 	bool decide(float aValue, const string_t& callerName, uint16_t sliceCount = 0);
 
+	/// 시간을 지정하여 판단, 기록된 샘플을 재생하여 전환 횟수를 점검할 때 사용
+	bool decideAt(float aValue, const string_t& callerName, uint16_t sliceCount, const timePoint_t& now);
+
+	/// 단계가 바뀐 누적 횟수
+	int32_t transitionCount() const
+	{
+		return m_transition_count;
+	}
+
 	BusyLevel_e::TYPE currentBusyLevel() const
 	{
 		return m_current_busy_level;
@@ -185,11 +229,33 @@ public:
 
 	void setOutlier(float aValue);
 
+	/// ASYNC_LOG_* 매크로가 사용, setup에서 바꾼 로거 이름으로 기록한다.
+	async_log_context_t asyncLogContext() const
+	{
+		async_log_context_t context;
+		context.m_logger_id = m_async_logger_id;
+		return context;
+	}
+
+private:
+	void registerMetrics(const string_t& loggerName);
+
+
+private:
+	struct level_rule_t
+	{
+		BusyLevel_e::TYPE m_level;
+		BusyLevel_e::TYPE m_step_down;
+		float m_enter_value;
+		float m_recover_value;
+	};
 
 private:
 	int32_t m_sample_count;
 
-	std::list<float> m_datas;
+	std::vector<float> m_datas; ///< 최근 m_sample_count개 ring
+	int32_t m_data_index{0};
+	double m_data_total{0.0};
 	spin_mutex_t m_datas_mutex;
 	spin_mutex_t m_outlier_mutex;
 
@@ -207,5 +273,17 @@ private:
 
 	bool m_use_session_action;
 	bool m_use_fatal_action;
+
+	float m_min_dwell{0.0f};
+	float m_min_transition_interval{0.0f};
+	bool m_step_recovery{false};
+	timePoint_t m_level_time_point; ///< 현재 단계 진입 시각, 첫 샘플 시각으로 시작
+	bool m_level_time_seeded{false};
+	int32_t m_transition_count{0};
+	uint32_t m_async_logger_id{0};
+
+	metric_id_t m_average_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_level_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_transition_metric_id{MetricsRegistry::INVALID_METRIC_ID};
 };
 
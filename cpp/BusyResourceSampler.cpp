@@ -0,0 +1,199 @@
+//
+
+#include "preheader.h"
+
+#include "BusyResourceSampler.h"
+#include "OutboundQuota.h"
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+BusyResourceSampler::BusyResourceSampler()
+{
+	setDefaultLoggerName("monitor.busylevel");
+
+	auto &registry = MetricsRegistry::instance();
+	for (int32_t resource = 0; resource < busy_resource_e::_END; ++resource)
+	{
+		string_t labels = "resource=\"" + busy_resource_e::ToString(static_cast<busy_resource_e::TYPE>(resource)) + "\"";
+		m_value_metric_ids[resource] = registry.registerGauge("busy_resource_value", labels);
+	}
+}
+
+BusyResourceSampler::~BusyResourceSampler()
+{
+	stop();
+}
+
+BusyResourceSampler &BusyResourceSampler::instance()
+{
+	static BusyResourceSampler s_instance;
+	return s_instance;
+}
+
+void BusyResourceSampler::setBusyLevel(CompositeBusyLevel *composite_busy_level, float interval_sec)
+{
+	spin_mutex_t::scoped_lock lock(m_mutex);
+	m_composite_busy_level = composite_busy_level;
+	m_interval = std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<float>(std::max(interval_sec, 0.01f)));
+}
+
+void BusyResourceSampler::setListenSocket(int native_handle)
+{
+	m_listen_socket.store(native_handle, std::memory_order_relaxed);
+}
+
+void BusyResourceSampler::setHandlerQueueDepthSource(depth_source_t handler_queue_depth_source)
+{
+	spin_mutex_t::scoped_lock lock(m_mutex);
+	m_handler_queue_depth_source = handler_queue_depth_source;
+}
+
+void BusyResourceSampler::start(gplat::asio::io_context &io_context)
+{
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		if (!m_composite_busy_level || m_timer)
+		{
+			return;
+		}
+		m_timer.reset(new boost::asio::steady_timer(io_context));
+	}
+	LOG_INFO("busy resource sampler started");
+	wait();
+}
+
+void BusyResourceSampler::stop()
+{
+	std::unique_ptr<boost::asio::steady_timer> timer;
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		timer.swap(m_timer);
+	}
+	if (timer)
+	{
+		timer->cancel();
+	}
+}
+
+void BusyResourceSampler::wait()
+{
+	spin_mutex_t::scoped_lock lock(m_mutex);
+	if (!m_timer)
+	{
+		return;
+	}
+
+	m_expected_time_point = clock_t::now() + m_interval;
+	m_timer->expires_at(m_expected_time_point);
+	m_timer->async_wait([this](const boost::system::error_code &error_code)
+						{
+							if (error_code)
+							{
+								return;
+							}
+
+							// 예정 시각보다 늦게 깨어난 만큼 io 스레드가 밀려 있었다.
+							clock_t::time_point expected_time_point;
+							{
+								spin_mutex_t::scoped_lock lock(m_mutex);
+								expected_time_point = m_expected_time_point;
+							}
+							float tick_overrun_ms = std::chrono::duration<float, std::milli>(clock_t::now() - expected_time_point).count();
+							sampleOnce(std::max(tick_overrun_ms, 0.0f));
+							wait();
+						});
+}
+
+bool BusyResourceSampler::sampleOnce(float tick_overrun_ms)
+{
+	CompositeBusyLevel *composite_busy_level = nullptr;
+	depth_source_t handler_queue_depth_source;
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		composite_busy_level = m_composite_busy_level;
+		handler_queue_depth_source = m_handler_queue_depth_source;
+	}
+	if (!composite_busy_level)
+	{
+		return false;
+	}
+
+	float values[busy_resource_e::_END] = {};
+	bool measured[busy_resource_e::_END] = {};
+
+	if (handler_queue_depth_source)
+	{
+		values[busy_resource_e::HANDLER_QUEUE_DEPTH] = static_cast<float>(handler_queue_depth_source());
+		measured[busy_resource_e::HANDLER_QUEUE_DEPTH] = true;
+	}
+
+	values[busy_resource_e::TICK_OVERRUN] = tick_overrun_ms;
+	measured[busy_resource_e::TICK_OVERRUN] = true;
+
+	values[busy_resource_e::RSS] = readRssMb();
+	measured[busy_resource_e::RSS] = (values[busy_resource_e::RSS] > 0.0f);
+
+	int listen_socket = m_listen_socket.load(std::memory_order_relaxed);
+	if (0 <= listen_socket)
+	{
+		values[busy_resource_e::ACCEPT_BACKLOG] = static_cast<float>(readAcceptBacklog(listen_socket));
+		measured[busy_resource_e::ACCEPT_BACKLOG] = true;
+	}
+
+	// 송신 대기는 OutboundQuota가 자기 지표와 같이 반영한다.
+	bool changed = OutboundQuota::sampleSendBacklog(*composite_busy_level);
+	for (int32_t resource = 0; resource < busy_resource_e::_END; ++resource)
+	{
+		if (!measured[resource])
+		{
+			continue;
+		}
+		MetricsRegistry::instance().setGauge(m_value_metric_ids[resource], values[resource]);
+		changed |= composite_busy_level->sample(static_cast<busy_resource_e::TYPE>(resource), values[resource]);
+	}
+	return changed;
+}
+
+float BusyResourceSampler::readRssMb()
+{
+#if defined(__linux__)
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (!file)
+	{
+		return 0.0f;
+	}
+	long total_pages = 0;
+	long resident_pages = 0;
+	int read_count = fscanf(file, "%ld %ld", &total_pages, &resident_pages);
+	fclose(file);
+	if (2 != read_count)
+	{
+		return 0.0f;
+	}
+	return static_cast<float>(static_cast<double>(resident_pages) * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0));
+#else
+	return 0.0f;
+#endif
+}
+
+int32_t BusyResourceSampler::readAcceptBacklog(int native_handle)
+{
+#if defined(__linux__)
+	// listen 소켓의 tcpi_unacked는 accept 대기 수
+	tcp_info info = {};
+	socklen_t length = sizeof(info);
+	if (0 != getsockopt(native_handle, IPPROTO_TCP, TCP_INFO, &info, &length))
+	{
+		return 0;
+	}
+	return static_cast<int32_t>(info.tcpi_unacked);
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,72 @@
+//
+#pragma once
+
+#include "CompositeBusyLevel.h"
+#include "MetricsRegistry.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+/**
+채널 CompositeBusyLevel에 자원별 측정값을 주기적으로 넣는다.
+- HANDLER_QUEUE_DEPTH : setHandlerQueueDepthSource로 등록한 함수가 돌려주는 핸들러 대기 수
+- TICK_OVERRUN : 샘플 타이머가 예정보다 늦게 깨어난 시간(ms), 타이머를 돌리는 io 스레드가 밀린 정도
+- RSS : 프로세스 상주 메모리(MB), linux에서만 /proc/self/statm으로 읽는다.
+- SEND_BACKLOG : 전체 세션 송신 대기(OutboundQuota::sampleSendBacklog)
+- ACCEPT_BACKLOG : setListenSocket으로 등록한 listen 소켓의 accept 대기 수, linux에서만 TCP_INFO로 읽는다.
+- 구간을 설정(CompositeBusyLevel::setup)하지 않은 자원은 CompositeBusyLevel이 판단에서 뺀다.
+- Session::init에서 start를 호출하므로 처음 세션의 io_context에서 한번만 시작된다.
+*/
+class BusyResourceSampler
+	: public LoggerBaseInfo
+{
+public:
+	typedef std::function<int32_t()> depth_source_t;
+	typedef std::chrono::steady_clock clock_t;
+
+public:
+	BusyResourceSampler();
+	~BusyResourceSampler();
+
+	static BusyResourceSampler &instance();
+
+public:
+	/// 샘플 대상, nullptr이면 샘플하지 않는다. 서버 시작시 설정
+	void setBusyLevel(CompositeBusyLevel *composite_busy_level, float interval_sec);
+
+	/// accept 대기 수를 읽을 listen 소켓, -1이면 해제
+	void setListenSocket(int native_handle);
+
+	/// 핸들러 대기 수를 돌려주는 함수, 샘플 타이머 스레드에서 호출된다.
+	void setHandlerQueueDepthSource(depth_source_t handler_queue_depth_source);
+
+	/// 샘플 타이머 시작, 대상이 없거나 이미 돌고 있으면 무시
+	void start(gplat::asio::io_context &io_context);
+	void stop();
+
+	/// 모든 자원을 한번 샘플한다. tick_overrun_ms는 호출측이 잰 지연, 합쳐진 단계가 바뀌면 true
+	bool sampleOnce(float tick_overrun_ms);
+
+public:
+	/// 실패하거나 지원하지 않는 플랫폼은 0
+	static float readRssMb();
+	static int32_t readAcceptBacklog(int native_handle);
+
+private:
+	void wait();
+
+private:
+	spin_mutex_t m_mutex;
+	CompositeBusyLevel *m_composite_busy_level{nullptr};
+	clock_t::duration m_interval{std::chrono::seconds(1)};
+	depth_source_t m_handler_queue_depth_source;
+	std::atomic<int> m_listen_socket{-1};
+
+	std::unique_ptr<boost::asio::steady_timer> m_timer;
+	clock_t::time_point m_expected_time_point;
+
+	metric_id_t m_value_metric_ids[busy_resource_e::_END];
+};
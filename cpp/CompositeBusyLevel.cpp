@@ -0,0 +1,101 @@
+//
+
+#include "preheader.h"
+
+#include "CompositeBusyLevel.h"
+#include <libGen/cpp/log/Logger.h>
+
+#include <cmath>
+
+CompositeBusyLevel::CompositeBusyLevel(combine_method_e::TYPE combine_method /*= combine_method_e::WORST*/)
+{
+	setDefaultLoggerName("monitor.busylevel");
+
+	m_combine_method = combine_method;
+	m_current_busy_level = BusyLevel_e::BUSY_IDLE;
+	m_responsible_resource = busy_resource_e::_END;
+
+	for (int32_t resource = 0; resource < busy_resource_e::_END; ++resource)
+	{
+		m_names[resource] = busy_resource_e::ToString(static_cast<busy_resource_e::TYPE>(resource));
+		m_weights[resource] = 1.0f;
+		m_used[resource] = false;
+	}
+}
+
+void CompositeBusyLevel::setup(busy_resource_e::TYPE resource, const BusyLevelParam &busyLevelParam, float weight /*= 1.0f*/)
+{
+	m_busy_levels[resource].setup(busyLevelParam, "monitor.busylevel." + m_names[resource]);
+	m_weights[resource] = weight;
+	m_used[resource] = m_busy_levels[resource].isValid();
+}
+
+bool CompositeBusyLevel::sample(busy_resource_e::TYPE resource, float aValue)
+{
+	if (!m_used[resource])
+	{
+		return false;
+	}
+
+	m_busy_levels[resource].decide(aValue, m_names[resource]);
+
+	spin_mutex_t::scoped_lock lock(m_combine_mutex);
+	BusyLevel_e::TYPE backupBusyLevel = m_current_busy_level;
+	combine();
+
+	if (backupBusyLevel != m_current_busy_level)
+	{
+		LOG_INFO("composite busy level changed {0} -> {1} resource:{2}", BusyLevel_e::ToString(backupBusyLevel), BusyLevel_e::ToString(m_current_busy_level), busy_resource_e::ToString(m_responsible_resource));
+		return true;
+	}
+	return false;
+}
+
+void CompositeBusyLevel::combine()
+{
+	// 단계값이 작을수록 심각하므로 IDLE과의 차이를 심각도로 사용한다.
+	BusyLevel_e::TYPE worstLevel = BusyLevel_e::BUSY_IDLE;
+	busy_resource_e::TYPE worstResource = busy_resource_e::_END;
+	float weightedSeverity = 0.0f;
+	float totalWeight = 0.0f;
+	float maxContribution = 0.0f;
+	busy_resource_e::TYPE maxContributionResource = busy_resource_e::_END;
+
+	for (int32_t index = 0; index < busy_resource_e::_END; ++index)
+	{
+		if (!m_used[index])
+		{
+			continue;
+		}
+
+		auto resource = static_cast<busy_resource_e::TYPE>(index);
+		BusyLevel_e::TYPE level = m_busy_levels[index].currentBusyLevel();
+		if (level < worstLevel)
+		{
+			worstLevel = level;
+			worstResource = resource;
+		}
+
+		float severity = static_cast<float>(BusyLevel_e::BUSY_IDLE - level);
+		float contribution = severity * m_weights[index];
+		weightedSeverity += contribution;
+		totalWeight += m_weights[index];
+		if (contribution > maxContribution)
+		{
+			maxContribution = contribution;
+			maxContributionResource = resource;
+		}
+	}
+
+	if (combine_method_e::WEIGHTED == m_combine_method && totalWeight > 0.0f)
+	{
+		int32_t severity = static_cast<int32_t>(std::lround(weightedSeverity / totalWeight));
+		m_current_busy_level = static_cast<BusyLevel_e::TYPE>(BusyLevel_e::BUSY_IDLE - severity);
+		m_responsible_resource = maxContributionResource;
+	}
+	else
+	{
+		m_current_busy_level = worstLevel;
+		m_responsible_resource = worstResource;
+	}
+}
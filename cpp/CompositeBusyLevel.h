@@ -0,0 +1,109 @@
+//
+#pragma once
+
+#include "BusyLevel.h"
+
+/// 복합 busy level 판단에 사용하는 자원
+struct busy_resource_e
+{
+	enum TYPE
+	{
+		HANDLER_QUEUE_DEPTH, // 핸들러 대기 수
+		TICK_OVERRUN,		 // 틱 초과 시간
+		RSS,				 // 프로세스 메모리
+		SEND_BACKLOG,		 // 세션 송신 대기 바이트
+		ACCEPT_BACKLOG,		 // 접속 수락 대기 수
+		_END
+	};
+
+	static string_t ToString(TYPE type)
+	{
+		switch (type)
+		{
+		case HANDLER_QUEUE_DEPTH: return "handler_queue_depth";
+		case TICK_OVERRUN: return "tick_overrun";
+		case RSS: return "rss";
+		case SEND_BACKLOG: return "send_backlog";
+		case ACCEPT_BACKLOG: return "accept_backlog";
+		case _END: return "EOE";
+		}
+
+		return "busy_resource_e::UNKNOWN";
+	}
+};
+
+/**
+여러 자원의 busy level을 각각 판단하고 하나의 BusyLevel_e::TYPE으로 합친다.
+- 자원마다 BusyLevel(구간, 샘플 수)을 따로 가진다. 설정하지 않은 자원은 판단에서 제외
+- WORST : 가장 심각한 자원의 단계, WEIGHTED : 자원별 단계를 가중 평균
+- 결과 단계의 원인이 된 자원을 responsibleResource()로 알 수 있다.
+- 샘플 하나당 비용은 자원 수에만 비례한다.
+*/
+class CompositeBusyLevel
+	: public LoggerBaseInfo
+{
+public:
+	struct combine_method_e
+	{
+		enum TYPE
+		{
+			WORST,
+			WEIGHTED
+		};
+	};
+
+public:
+	CompositeBusyLevel(combine_method_e::TYPE combine_method = combine_method_e::WORST);
+
+public:
+	void setup(busy_resource_e::TYPE resource, const BusyLevelParam &busyLevelParam, float weight = 1.0f);
+
+	void setCombineMethod(combine_method_e::TYPE combine_method)
+	{
+		m_combine_method = combine_method;
+	}
+
+	/// 자원 샘플 입력, 합쳐진 단계가 바뀌면 true
+	bool sample(busy_resource_e::TYPE resource, float aValue);
+
+	BusyLevel_e::TYPE currentBusyLevel() const
+	{
+		return m_current_busy_level;
+	}
+
+	busy_resource_e::TYPE responsibleResource() const
+	{
+		return m_responsible_resource;
+	}
+
+	const BusyLevel &resourceBusyLevel(busy_resource_e::TYPE resource) const
+	{
+		return m_busy_levels[resource];
+	}
+
+	bool isValid() const
+	{
+		for (auto used : m_used)
+		{
+			if (used)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	void combine();
+
+private:
+	BusyLevel m_busy_levels[busy_resource_e::_END];
+	string_t m_names[busy_resource_e::_END];
+	float m_weights[busy_resource_e::_END];
+	bool m_used[busy_resource_e::_END];
+
+	combine_method_e::TYPE m_combine_method;
+	BusyLevel_e::TYPE m_current_busy_level;
+	busy_resource_e::TYPE m_responsible_resource;
+	spin_mutex_t m_combine_mutex;
+};
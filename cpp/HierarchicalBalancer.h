@@ -0,0 +1,423 @@
+//
+#pragma once
+
+#include <libGen/cpp/base/BusyLevel.h>
+#include "MetricsRegistry.h"
+#include <map>
+#include <set>
+#include <unordered_map>
+
+/**
+지역 -> 월드 -> 게임서버 트리 할당
+- 그룹 노드는 하위의 여유 인원(headroom) 합계, 입장 가능 서버의 인원/기준인원 합계, 혼잡도별 서버 수를 유지한다.
+- 자식 노드는 (여유 인원, 입장 가능 서버 유무, 사용률, 순번) 정렬 set에 들어 있어 할당은 O(깊이 * log 자식수)
+- 여유 인원이 같으면(모두 가득 찬 경우 포함) ServerBalancer::alloc처럼 사용률(인원 / 기준인원)이 낮은 쪽으로 보낸다.
+- 서버 인원/혼잡도 변경은 해당 서버에서 루트까지 차이값만 올려보낸다.
+- 여유 인원이 있는 서버가 없으면 입장 가능한(BUSY_WARN 이상) 서버가 있는 쪽으로 내려간다.
+*/
+template <typename BALANCE_OBJECT>
+class HierarchicalBalancer
+	: public LoggerBaseInfo
+{
+public:
+	static const int32_t ROOT_GROUP_ID = 0;
+
+public:
+	HierarchicalBalancer()
+	{
+		setDefaultLoggerName("balancer.hierarchy");
+
+		m_root.reset(new node_t);
+		m_root->m_node_id = ROOT_GROUP_ID;
+		m_root->m_seq = m_last_seq++;
+		m_groups[m_root->m_node_id] = m_root;
+	}
+
+	/// 운영에 쓰는 인스턴스가 한번 호출한다. 호출하지 않은 인스턴스는 지표를 남기지 않는다.
+	void registerMetrics(const string_t &name)
+	{
+		if (MetricsRegistry::INVALID_METRIC_ID != m_alloc_metric_id)
+		{
+			return;
+		}
+		auto &registry = MetricsRegistry::instance();
+		string_t labels = registry.instanceLabels(name);
+		m_alloc_metric_id = registry.registerCounter("balancer_alloc_total", labels);
+		m_alloc_fail_metric_id = registry.registerCounter("balancer_alloc_fail_total", labels);
+		m_server_count_metric_id = registry.registerGauge("balancer_server_count", labels);
+	}
+
+public:
+	/// 그룹(지역, 월드 등) 추가, parent_group_id가 ROOT_GROUP_ID이면 최상위
+	gplat::Result addGroup(int32_t parent_group_id, int32_t group_id)
+	{
+		gplat::Result gen_result;
+		auto parent_it = m_groups.find(parent_group_id);
+		if (parent_it == m_groups.end())
+		{
+			return gen_result.setFail(sformat("parent_group_id:{0} not exist", parent_group_id));
+		}
+		if (m_groups.count(group_id))
+		{
+			return gen_result.setFail(sformat("group_id:{0} already exist", group_id));
+		}
+
+		boost::shared_ptr<node_t> group(new node_t);
+		group->m_node_id = group_id;
+		group->m_seq = m_last_seq++;
+		group->m_parent = parent_it->second.get();
+		m_groups[group_id] = group;
+		attachChild(*group);
+		return gen_result.setOk();
+	}
+
+	/// 하위 그룹/서버가 없는 그룹만 제거 가능
+	gplat::Result removeGroup(int32_t group_id)
+	{
+		gplat::Result gen_result;
+		auto it = m_groups.find(group_id);
+		if (it == m_groups.end() || ROOT_GROUP_ID == group_id)
+		{
+			return gen_result.setFail(sformat("group_id:{0} not removable", group_id));
+		}
+		if (!it->second->m_children.empty())
+		{
+			return gen_result.setFail(sformat("group_id:{0} not empty", group_id));
+		}
+		detachChild(*it->second);
+		m_groups.erase(it);
+		return gen_result.setOk();
+	}
+
+	gplat::Result registerServer(int32_t group_id, boost::shared_ptr<BALANCE_OBJECT> balance_object, int32_t fill_user_count)
+	{
+		gplat::Result gen_result;
+		auto group_it = m_groups.find(group_id);
+		if (group_it == m_groups.end())
+		{
+			return gen_result.setFail(sformat("group_id:{0} not exist", group_id));
+		}
+		int32_t server_id = balance_object->balanceKeyServerId();
+		if (m_servers.count(server_id))
+		{
+			return gen_result.setFail(sformat("server_id:{0} already exist", server_id));
+		}
+
+		balance_object->setBusyLevel(BusyLevel_e::BUSY_IDLE);
+
+		boost::shared_ptr<node_t> server(new node_t);
+		server->m_node_id = server_id;
+		server->m_seq = m_last_seq++;
+		server->m_parent = group_it->second.get();
+		server->m_balance_object = balance_object;
+		server->m_server_fill_user_count = fill_user_count;
+		m_servers[server_id] = server;
+
+		// 빈 상태로 붙인 후 현재값을 반영하여 위로 올린다.
+		attachChild(*server);
+		updateServer(server_id);
+
+		MetricsRegistry::instance().setGauge(m_server_count_metric_id, static_cast<double>(m_servers.size()));
+		LOG_TRACE("registered: group_id:{0} balanceKeyServerId:{1}", group_id, server_id);
+		return gen_result.setOk();
+	}
+
+	void unregisterServer(int32_t server_id)
+	{
+		auto it = m_servers.find(server_id);
+		if (it == m_servers.end())
+		{
+			return;
+		}
+
+		node_t &server = *it->second;
+		applyLeaf(server, leaf_value_t(), BusyLevel_e::_BEGIN, false);
+		detachChild(server);
+		m_servers.erase(it);
+
+		MetricsRegistry::instance().setGauge(m_server_count_metric_id, static_cast<double>(m_servers.size()));
+		LOG_TRACE("unregistered: balanceKeyServerId:{0}", server_id);
+	}
+
+	/// 서버 인원(balanceKeyUserCount) 또는 혼잡도가 바뀐 후 호출, 루트까지 차이값만 반영한다.
+	void updateServer(int32_t server_id)
+	{
+		auto it = m_servers.find(server_id);
+		if (it == m_servers.end())
+		{
+			return;
+		}
+
+		node_t &server = *it->second;
+		const BALANCE_OBJECT &balance_object = *server.m_balance_object;
+		BusyLevel_e::TYPE busy_level = balance_object.busyLevel();
+		leaf_value_t leaf_value;
+		if (busy_level >= BusyLevel_e::BUSY_WARN)
+		{
+			leaf_value.m_headroom = std::max(0, server.m_server_fill_user_count - balance_object.balanceKeyUserCount());
+			leaf_value.m_user_count = balance_object.balanceKeyUserCount();
+			leaf_value.m_fill_user_count = server.m_server_fill_user_count;
+		}
+		applyLeaf(server, leaf_value, busy_level, true);
+	}
+
+	void changeServerBusyLevel(int32_t server_id, BusyLevel_e::TYPE busy_level)
+	{
+		auto it = m_servers.find(server_id);
+		if (it == m_servers.end())
+		{
+			return;
+		}
+		it->second->m_balance_object->setBusyLevel(busy_level);
+		updateServer(server_id);
+	}
+
+	void changeServerFillUserCount(int32_t server_id, int32_t fill_user_count)
+	{
+		auto it = m_servers.find(server_id);
+		if (it == m_servers.end())
+		{
+			return;
+		}
+		it->second->m_server_fill_user_count = fill_user_count;
+		updateServer(server_id);
+	}
+
+public:
+	/// group_id 아래에서 여유 인원이 가장 많은 쪽으로 내려가 서버를 고른다.
+	boost::shared_ptr<BALANCE_OBJECT> alloc(int32_t group_id = ROOT_GROUP_ID)
+	{
+		auto group_it = m_groups.find(group_id);
+		if (group_it == m_groups.end())
+		{
+			LOG_ERROR("group_id:{0} not exist", group_id);
+			MetricsRegistry::instance().addCounter(m_alloc_fail_metric_id);
+			return boost::shared_ptr<BALANCE_OBJECT>();
+		}
+
+		const node_t *node = group_it->second.get();
+		while (!node->m_balance_object)
+		{
+			if (node->m_child_keys.empty())
+			{
+				break;
+			}
+			node = node->m_child_keys.rbegin()->m_node;
+		}
+
+		if (!node->m_balance_object || node->m_busy_level < BusyLevel_e::BUSY_WARN)
+		{
+			LOG_TRACE("no idle gameserver. group_id:{0}", group_id);
+			MetricsRegistry::instance().addCounter(m_alloc_fail_metric_id);
+			return boost::shared_ptr<BALANCE_OBJECT>();
+		}
+
+		MetricsRegistry::instance().addCounter(m_alloc_metric_id);
+		return node->m_balance_object;
+	}
+
+	/// 모두가 특정 상태 이하이면, 루트 집계로 판단
+	bool allBusyLevelUnder(BusyLevel_e::TYPE busy_level, int32_t group_id = ROOT_GROUP_ID)
+	{
+		auto group_it = m_groups.find(group_id);
+		if (group_it == m_groups.end())
+		{
+			return true;
+		}
+		const node_t &group = *group_it->second;
+		for (int32_t level = busy_level + 1; level < BusyLevel_e::_END; ++level)
+		{
+			if (0 < group.m_level_counts[level])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// 가장 혼잡한 서버의 혼잡도, 서버가 없으면 BUSY_IDLE
+	BusyLevel_e::TYPE worstBusyLevel(int32_t group_id = ROOT_GROUP_ID)
+	{
+		auto group_it = m_groups.find(group_id);
+		if (group_it == m_groups.end())
+		{
+			return BusyLevel_e::BUSY_IDLE;
+		}
+		const node_t &group = *group_it->second;
+		for (int32_t level = BusyLevel_e::_BEGIN; level < BusyLevel_e::_END; ++level)
+		{
+			if (0 < group.m_level_counts[level])
+			{
+				return static_cast<BusyLevel_e::TYPE>(level);
+			}
+		}
+		return BusyLevel_e::BUSY_IDLE;
+	}
+
+	int32_t headroom(int32_t group_id = ROOT_GROUP_ID)
+	{
+		auto group_it = m_groups.find(group_id);
+		if (group_it == m_groups.end())
+		{
+			return 0;
+		}
+		return group_it->second->m_headroom;
+	}
+
+	int32_t serverCount()
+	{
+		return static_cast<int32_t>(m_servers.size());
+	}
+
+private:
+	struct node_t;
+
+	struct child_key_t
+	{
+		int32_t m_headroom;
+		bool m_usable;
+		int64_t m_user_count;
+		int64_t m_fill_user_count;
+		uint32_t m_seq;
+		node_t *m_node;
+	};
+
+	/// set의 마지막이 우선 : 여유 인원이 많은 쪽, 입장 가능한 쪽, 사용률이 낮은 쪽, 순번이 작은 쪽
+	struct child_key_less_t
+	{
+		bool operator()(const child_key_t &left, const child_key_t &right) const
+		{
+			if (left.m_headroom != right.m_headroom)
+			{
+				return left.m_headroom < right.m_headroom;
+			}
+			if (left.m_usable != right.m_usable)
+			{
+				return !left.m_usable;
+			}
+			// 기준인원 0(입장 가능 서버 없음)은 가장 높은 사용률로 본다.
+			if ((0 == left.m_fill_user_count) != (0 == right.m_fill_user_count))
+			{
+				return 0 == left.m_fill_user_count;
+			}
+			int64_t left_usage = left.m_user_count * right.m_fill_user_count;
+			int64_t right_usage = right.m_user_count * left.m_fill_user_count;
+			if (left_usage != right_usage)
+			{
+				return left_usage > right_usage;
+			}
+			return left.m_seq > right.m_seq;
+		}
+	};
+
+	/// 서버 노드가 조상에 더하는 값, 입장 불가 서버는 모두 0
+	struct leaf_value_t
+	{
+		int32_t m_headroom{0};
+		int32_t m_user_count{0};
+		int32_t m_fill_user_count{0};
+	};
+
+	struct node_t
+	{
+		int32_t m_node_id{0};
+		uint32_t m_seq{0};
+		node_t *m_parent{nullptr};
+
+		int32_t m_headroom{0};
+		int32_t m_usable_count{0};	   ///< BUSY_WARN 이상 서버 수
+		int64_t m_user_count{0};	   ///< BUSY_WARN 이상 서버 인원 합계
+		int64_t m_fill_user_count{0}; ///< BUSY_WARN 이상 서버 기준인원 합계
+		int32_t m_level_counts[BusyLevel_e::_END] = {};
+
+		std::map<uint32_t, node_t *> m_children; ///< 순번 -> 자식
+		std::set<child_key_t, child_key_less_t> m_child_keys;
+
+		// 서버 노드
+		boost::shared_ptr<BALANCE_OBJECT> m_balance_object;
+		int32_t m_server_fill_user_count{0}; ///< 서버 기준인원
+		BusyLevel_e::TYPE m_busy_level{BusyLevel_e::_BEGIN}; ///< 반영된 혼잡도, _BEGIN이면 미반영
+		bool m_counted{false};
+
+		child_key_t childKey()
+		{
+			return child_key_t{m_headroom, 0 < m_usable_count, m_user_count, m_fill_user_count, m_seq, this};
+		}
+	};
+
+	void attachChild(node_t &child)
+	{
+		node_t &parent = *child.m_parent;
+		parent.m_children[child.m_seq] = &child;
+		parent.m_child_keys.insert(child.childKey());
+	}
+
+	void detachChild(node_t &child)
+	{
+		node_t &parent = *child.m_parent;
+		parent.m_child_keys.erase(child.childKey());
+		parent.m_children.erase(child.m_seq);
+	}
+
+	/// 서버 노드 값을 바꾸고 조상 노드에 차이값을 반영한다.
+	void applyLeaf(node_t &server, const leaf_value_t &leaf_value, BusyLevel_e::TYPE busy_level, bool counted)
+	{
+		int32_t headroom_delta = leaf_value.m_headroom - server.m_headroom;
+		int32_t usable_delta = (counted && busy_level >= BusyLevel_e::BUSY_WARN ? 1 : 0) - server.m_usable_count;
+		int64_t user_count_delta = leaf_value.m_user_count - server.m_user_count;
+		int64_t fill_user_count_delta = leaf_value.m_fill_user_count - server.m_fill_user_count;
+		bool level_changed = (server.m_counted != counted) || (server.m_busy_level != busy_level);
+		if (0 == headroom_delta && 0 == usable_delta && 0 == user_count_delta && 0 == fill_user_count_delta && !level_changed)
+		{
+			return;
+		}
+
+		BusyLevel_e::TYPE old_busy_level = server.m_busy_level;
+		bool old_counted = server.m_counted;
+
+		node_t *node = &server;
+		while (node)
+		{
+			node_t *parent = node->m_parent;
+			if (parent)
+			{
+				parent->m_child_keys.erase(node->childKey());
+			}
+
+			node->m_headroom += headroom_delta;
+			node->m_usable_count += usable_delta;
+			node->m_user_count += user_count_delta;
+			node->m_fill_user_count += fill_user_count_delta;
+			if (level_changed)
+			{
+				if (old_counted)
+				{
+					--node->m_level_counts[old_busy_level];
+				}
+				if (counted)
+				{
+					++node->m_level_counts[busy_level];
+				}
+			}
+
+			if (parent)
+			{
+				parent->m_child_keys.insert(node->childKey());
+			}
+			node = parent;
+		}
+
+		server.m_busy_level = busy_level;
+		server.m_counted = counted;
+	}
+
+private:
+	boost::shared_ptr<node_t> m_root;
+	std::unordered_map<int32_t, boost::shared_ptr<node_t>> m_groups;  ///< group_id -> 그룹 노드
+	std::unordered_map<int32_t, boost::shared_ptr<node_t>> m_servers; ///< server_id -> 서버 노드
+	uint32_t m_last_seq{0};
+
+	metric_id_t m_alloc_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_alloc_fail_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_server_count_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+};
@@ -0,0 +1,41 @@
+//
+#pragma once
+
+#include "ServerBalancer.h"
+
+class LogicServer;
+
+typedef ServerBalancer<LogicServer> logic_server_balancer_t;
+
+// 채널에 붙은 로직서버 balancer, 로직서버 세션 처리시 syncLogicServerBalancer로 등록/혼잡도를 맞추고
+// 로직서버 세션이 끊어지면 LogicServerFailover가 해제 후 이 balancer로 재배치한다.
+inline logic_server_balancer_t &logicServerBalancer()
+{
+	static logic_server_balancer_t s_logic_server_balancer;
+	static const bool s_metrics_registered = []()
+	{
+		s_logic_server_balancer.registerMetrics("balancer.logicserver");
+		return true;
+	}();
+	(void)s_metrics_registered;
+	return s_logic_server_balancer;
+}
+
+// 로직서버 세션 메시지 처리시 호출, 처음 보는 서버면 등록하고 현재 혼잡도와 인원을 색인에 반영한다.
+// 등록시 balancer가 혼잡도를 IDLE로 초기화하므로 등록 전 값을 다시 넣는다.
+template <typename LOGIC_SERVER>
+inline void syncLogicServerBalancer(const boost::shared_ptr<LOGIC_SERVER> &logic_server)
+{
+	if (!logic_server)
+	{
+		return;
+	}
+	auto &balancer = logicServerBalancer();
+	int32_t server_id = logic_server->balanceKeyServerId();
+	auto busy_level = logic_server->busyLevel();
+	if (!balancer.hasServer(server_id))
+	{
+		balancer.registerServer(logic_server);
+	}
+	balancer.changeServerBusyLevel(server_id, busy_level);
+}
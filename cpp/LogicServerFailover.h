@@ -0,0 +1,138 @@
+//
+#pragma once
+
+#include "ServerBalancer.h"
+#include <boost/chrono.hpp>
+#include <boost/function.hpp>
+#include <map>
+
+/**
+로직서버 장애시 해당 로직서버에 묶여있던 채널 세션을 살아있는 로직서버로 일괄 재배치한다.
+- 장애 서버는 balancer에서 해제하고, 세션마다 ServerBalancer::alloc(lease)로 대상 서버를 고른다.
+  잡은 lease가 바로 사용률에 반영되므로 보고 인원을 기다리지 않아도 alloc 기준대로 나뉜다.
+- 사용자 단위가 아니라 대상 서버별 묶음(batch) 단위로 재등록을 흘려 보낸다. 응답은 기다리지 않고 보낸 만큼 lease를 확정한다.
+*/
+template <typename BALANCE_OBJECT>
+class LogicServerFailover
+	: public LoggerBaseInfo
+{
+public:
+	typedef boost::shared_ptr<BALANCE_OBJECT> balance_object_ptr_t;
+	typedef ServerBalancer<BALANCE_OBJECT> balancer_t;
+	/// 대상 서버와 재배치할 세션 묶음을 전달 받는다.
+	typedef boost::function<void(balance_object_ptr_t, const std::vector<uint64_t> &)> rebind_batch_t;
+
+	typedef boost::chrono::high_resolution_clock clock_t;
+	typedef boost::chrono::duration<double> duration_t;
+
+public:
+	LogicServerFailover()
+	{
+		setDefaultLoggerName("failover.logicserver");
+	}
+
+public:
+	void setBatchSize(int32_t batch_size)
+	{
+		m_batch_size = std::max(batch_size, 1);
+	}
+
+	/// 재배치된 세션 수를 리턴한다. 살아있는 서버가 없으면 0
+	int32_t rebind(int32_t failed_server_id, balancer_t &balancer, const std::vector<uint64_t> &session_ids, rebind_batch_t rebind_batch)
+	{
+		auto start_time_point = clock_t::now();
+
+		m_last_rebind_count = 0;
+		m_last_recover_sec = 0.0;
+
+		// 이미 해제되었으면 아무것도 하지 않는다.
+		balancer.unregisterServer(failed_server_id);
+		// 보고 인원이 색인에 반영되지 않은 서버가 있을 수 있으므로 한번 맞추고 시작한다.
+		balancer.refreshServers();
+
+		if (session_ids.empty())
+		{
+			return 0;
+		}
+
+		// 대상 서버별 세션 묶음, 등록 순서대로 보낸다.
+		std::vector<target_t> targets;
+		std::map<int32_t, size_t> target_indexes; ///< server_id -> targets index
+		int32_t placed_count = 0;
+		for (auto session_id : session_ids)
+		{
+			typename balancer_t::balance_lease_t lease;
+			balance_object_ptr_t balance_object = balancer.alloc(lease, m_lease_timeout_sec);
+			if (!balance_object)
+			{
+				LOG_ERROR("no alive logic server. failed_server_id:{0} unplaced_count:{1}", failed_server_id, session_ids.size() - placed_count);
+				break;
+			}
+
+			auto index_it = target_indexes.find(lease.m_server_id);
+			if (index_it == target_indexes.end())
+			{
+				index_it = target_indexes.emplace(lease.m_server_id, targets.size()).first;
+				targets.push_back(target_t{balance_object});
+			}
+			target_t &target = targets[index_it->second];
+			target.m_session_ids.push_back(session_id);
+			target.m_lease_ids.push_back(lease.m_lease_id);
+			++placed_count;
+		}
+
+		// 대상 서버별로 batch 단위로 흘려보낸다.
+		std::vector<uint64_t> batch;
+		batch.reserve(m_batch_size);
+		for (const auto &target : targets)
+		{
+			for (size_t offset = 0; offset < target.m_session_ids.size(); offset += m_batch_size)
+			{
+				size_t end = std::min(offset + m_batch_size, target.m_session_ids.size());
+				batch.assign(target.m_session_ids.begin() + offset, target.m_session_ids.begin() + end);
+				rebind_batch(target.m_balance_object, batch);
+
+				for (size_t index = offset; index < end; ++index)
+				{
+					balancer.confirmLease(target.m_lease_ids[index]);
+				}
+			}
+
+			LOG_INFO("rebind failed_server_id:{0} -> server_id:{1} session_count:{2}", failed_server_id, target.m_balance_object->balanceKeyServerId(), target.m_session_ids.size());
+		}
+
+		duration_t elapsed = clock_t::now() - start_time_point;
+		m_last_rebind_count = placed_count;
+		m_last_recover_sec = elapsed.count();
+
+		LOG_INFO("failover complete failed_server_id:{0} session_count:{1} server_count:{2} elapsed_sec:{3}", failed_server_id, m_last_rebind_count, targets.size(), m_last_recover_sec);
+		return m_last_rebind_count;
+	}
+
+	int32_t lastRebindCount() const
+	{
+		return m_last_rebind_count;
+	}
+
+	/// 마지막 재배치에 걸린 시간(초), 복구시간 측정용
+	double lastRecoverSec() const
+	{
+		return m_last_recover_sec;
+	}
+
+public:
+	float m_lease_timeout_sec{10.0f}; ///< 재등록 전송 전까지 lease 유지 시간
+
+private:
+	struct target_t
+	{
+		balance_object_ptr_t m_balance_object;
+		std::vector<uint64_t> m_session_ids;
+		std::vector<uint64_t> m_lease_ids;
+	};
+
+private:
+	size_t m_batch_size{500};
+	int32_t m_last_rebind_count{0};
+	double m_last_recover_sec{0.0};
+};
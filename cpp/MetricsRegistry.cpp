@@ -0,0 +1,299 @@
+//
+
+#include "preheader.h"
+
+#include "MetricsRegistry.h"
+#include <libGen/cpp/log/Logger.h>
+
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/write.hpp>
+#include <cstdio>
+#include <fstream>
+
+MetricsRegistry::MetricsRegistry()
+{
+	for (auto &gauge : m_gauges)
+	{
+		gauge.store(0.0, std::memory_order_relaxed);
+	}
+	clearShard(m_shared_shard);
+	m_shards.push_back(&m_shared_shard);
+}
+
+metric_id_t MetricsRegistry::registerCounter(const string_t &name, const string_t &labels /*= ""*/)
+{
+	return registerMetric(m_counter_infos, MAX_COUNTER_COUNT, "counter:" + name, labels);
+}
+
+metric_id_t MetricsRegistry::registerGauge(const string_t &name, const string_t &labels /*= ""*/)
+{
+	return registerMetric(m_gauge_infos, MAX_GAUGE_COUNT, "gauge:" + name, labels);
+}
+
+metric_id_t MetricsRegistry::registerHistogram(const string_t &name, const string_t &labels /*= ""*/)
+{
+	return registerMetric(m_histogram_infos, MAX_HISTOGRAM_COUNT, "histogram:" + name, labels);
+}
+
+string_t MetricsRegistry::instanceLabels(const string_t &name)
+{
+	std::lock_guard<std::mutex> lock(m_register_mutex);
+	uint32_t instance = m_instance_counts[name]++;
+	return sformat("name=\"{0}\",instance=\"{1}\"", name, instance);
+}
+
+metric_id_t MetricsRegistry::registerMetric(std::vector<metric_info_t> &infos, uint32_t max_count, const string_t &name, const string_t &labels)
+{
+	std::lock_guard<std::mutex> lock(m_register_mutex);
+
+	string_t key = name + "{" + labels + "}";
+	auto it = m_metric_ids.find(key);
+	if (it != m_metric_ids.end())
+	{
+		return it->second;
+	}
+
+	if (infos.size() >= max_count)
+	{
+		return INVALID_METRIC_ID;
+	}
+
+	metric_id_t id = static_cast<metric_id_t>(infos.size());
+	infos.push_back(metric_info_t{name.substr(name.find(':') + 1), labels});
+	m_metric_ids[key] = id;
+	return id;
+}
+
+MetricsRegistry::thread_shard_t *MetricsRegistry::createShard()
+{
+	auto thread_shard = new thread_shard_t;
+	clearShard(*thread_shard);
+
+	std::lock_guard<std::mutex> lock(m_shards_mutex);
+	m_shards.push_back(thread_shard);
+	return thread_shard;
+}
+
+void MetricsRegistry::clearShard(thread_shard_t &thread_shard)
+{
+	for (auto &counter : thread_shard.m_counters)
+	{
+		counter.store(0, std::memory_order_relaxed);
+	}
+	for (auto &buckets : thread_shard.m_histogram_buckets)
+	{
+		for (auto &bucket : buckets)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
+	}
+	for (auto &sum : thread_shard.m_histogram_sums)
+	{
+		sum.store(0, std::memory_order_relaxed);
+	}
+}
+
+namespace
+{
+	void appendType(string_t &output, const string_t &name, const char *type)
+	{
+		output += "# TYPE ";
+		output += name;
+		output += " ";
+		output += type;
+		output += "\n";
+	}
+
+	// 같은 이름의 series는 붙어 있어야 하므로 이름별로 묶는다. 등록 순서 유지
+	template <typename INFO>
+	std::vector<std::vector<size_t>> groupByName(const std::vector<INFO> &infos)
+	{
+		std::vector<std::vector<size_t>> groups;
+		std::map<string_t, size_t> group_indexes;
+		for (size_t id = 0; id < infos.size(); ++id)
+		{
+			auto it = group_indexes.find(infos[id].m_name);
+			if (it == group_indexes.end())
+			{
+				it = group_indexes.emplace(infos[id].m_name, groups.size()).first;
+				groups.emplace_back();
+			}
+			groups[it->second].push_back(id);
+		}
+		return groups;
+	}
+
+	void appendSeries(string_t &output, const string_t &name, const string_t &labels, const string_t &extra_label, const string_t &value)
+	{
+		output += name;
+		if (!labels.empty() || !extra_label.empty())
+		{
+			output += "{";
+			output += labels;
+			if (!labels.empty() && !extra_label.empty())
+			{
+				output += ",";
+			}
+			output += extra_label;
+			output += "}";
+		}
+		output += " ";
+		output += value;
+		output += "\n";
+	}
+} // namespace
+
+void MetricsRegistry::exportText(_out string_t &output)
+{
+	output.clear();
+
+	std::vector<metric_info_t> counter_infos, gauge_infos, histogram_infos;
+	{
+		std::lock_guard<std::mutex> lock(m_register_mutex);
+		counter_infos = m_counter_infos;
+		gauge_infos = m_gauge_infos;
+		histogram_infos = m_histogram_infos;
+	}
+
+	std::vector<thread_shard_t *> shards;
+	{
+		std::lock_guard<std::mutex> lock(m_shards_mutex);
+		shards = m_shards;
+	}
+
+	for (const auto &group : groupByName(counter_infos))
+	{
+		appendType(output, counter_infos[group.front()].m_name, "counter");
+		for (size_t id : group)
+		{
+			uint64_t total = 0;
+			for (auto thread_shard : shards)
+			{
+				total += thread_shard->m_counters[id].load(std::memory_order_relaxed);
+			}
+			appendSeries(output, counter_infos[id].m_name, counter_infos[id].m_labels, "", std::to_string(total));
+		}
+	}
+
+	for (const auto &group : groupByName(gauge_infos))
+	{
+		appendType(output, gauge_infos[group.front()].m_name, "gauge");
+		for (size_t id : group)
+		{
+			appendSeries(output, gauge_infos[id].m_name, gauge_infos[id].m_labels, "", std::to_string(m_gauges[id].load(std::memory_order_relaxed)));
+		}
+	}
+
+	for (const auto &group : groupByName(histogram_infos))
+	{
+		appendType(output, histogram_infos[group.front()].m_name, "histogram");
+		for (size_t id : group)
+		{
+			const auto &info = histogram_infos[id];
+			uint64_t cumulative = 0;
+			uint64_t sum = 0;
+			for (uint32_t bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; ++bucket)
+			{
+				for (auto thread_shard : shards)
+				{
+					cumulative += thread_shard->m_histogram_buckets[id][bucket].load(std::memory_order_relaxed);
+				}
+
+				// bucket n은 [2^(n-1), 2^n) 구간이므로 상한은 2^n - 1
+				string_t le = (bucket + 1 == HISTOGRAM_BUCKET_COUNT) ? "+Inf" : std::to_string((uint64_t(1) << bucket) - 1);
+				appendSeries(output, info.m_name + "_bucket", info.m_labels, "le=\"" + le + "\"", std::to_string(cumulative));
+			}
+			for (auto thread_shard : shards)
+			{
+				sum += thread_shard->m_histogram_sums[id].load(std::memory_order_relaxed);
+			}
+			appendSeries(output, info.m_name + "_sum", info.m_labels, "", std::to_string(sum));
+			appendSeries(output, info.m_name + "_count", info.m_labels, "", std::to_string(cumulative));
+		}
+	}
+}
+
+void MetricsExporter::start(const string_t &target_path, float interval_sec)
+{
+	stop();
+
+	m_target_path = target_path;
+	m_interval_sec = interval_sec;
+	m_stop = false;
+	m_thread = std::thread([this]() { run(); });
+
+	LOG_INFO("metrics exporter started. target:{0} interval:{1}", m_target_path, m_interval_sec);
+}
+
+void MetricsExporter::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_stop_cond.notify_all();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+void MetricsExporter::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stop)
+	{
+		m_stop_cond.wait_for(lock, std::chrono::duration<float>(m_interval_sec));
+		if (m_stop)
+		{
+			break;
+		}
+
+		lock.unlock();
+		gplat::Result res = exportOnce();
+		if (res.fail())
+		{
+			LOG_WARN("metrics export failed. target:{0}", m_target_path);
+		}
+		lock.lock();
+	}
+}
+
+gplat::Result MetricsExporter::exportOnce()
+{
+	gplat::Result gen_result;
+	MetricsRegistry::instance().exportText(m_buffer);
+
+	const string_t unix_prefix = "unix:";
+	if (0 == m_target_path.compare(0, unix_prefix.size(), unix_prefix))
+	{
+		try
+		{
+			boost::asio::io_context io_context;
+			boost::asio::local::stream_protocol::socket sock(io_context);
+			sock.connect(boost::asio::local::stream_protocol::endpoint(m_target_path.substr(unix_prefix.size())));
+			boost::asio::write(sock, boost::asio::buffer(m_buffer));
+		}
+		catch (const boost::system::system_error &ex)
+		{
+			return gen_result.setFail(sformat("metrics unix socket write failed:{0} {1}", m_target_path, ex.what()));
+		}
+		return gen_result.setOk();
+	}
+
+	string_t temp_path = m_target_path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return gen_result.setFail(sformat("metrics file open failed:{0}", temp_path));
+		}
+		file.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+	}
+	if (0 != std::rename(temp_path.c_str(), m_target_path.c_str()))
+	{
+		return gen_result.setFail(sformat("metrics file rename failed:{0}", m_target_path));
+	}
+	return gen_result.setOk();
+}
@@ -0,0 +1,209 @@
+//
+#pragma once
+
+#include "Concurrency.h"
+#include "BitOps.h"
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef uint32_t metric_id_t;
+
+/**
+counter, gauge, histogram 지표 저장소
+- 등록(register*)은 초기화 시점에 한번 수행하고 id를 보관해서 사용한다. 이름+라벨이 같으면 같은 id
+- counter, histogram은 스레드별 shard에 누적하고 내보낼 때 합산한다. 갱신시 잠금, 할당, lock 명령이 없다.
+- 스레드 shard는 attachThread()에서만 만든다. io, 작업 스레드는 시작시 attachThread를 호출해야 한다.
+- attachThread를 호출하지 않은 스레드의 갱신은 공용 shard에 atomic으로 더한다. 할당은 없지만 lock 명령이 들어간다.
+- gauge는 마지막 값만 의미가 있으므로 하나의 atomic에 기록한다.
+*/
+class MetricsRegistry
+{
+public:
+	static const metric_id_t INVALID_METRIC_ID = 0xFFFFFFFF;
+	static const uint32_t MAX_COUNTER_COUNT = 512;
+	static const uint32_t MAX_GAUGE_COUNT = 512;
+	static const uint32_t MAX_HISTOGRAM_COUNT = 64;
+	static const uint32_t HISTOGRAM_BUCKET_COUNT = 32; ///< 2의 거듭제곱 구간, 마지막은 +Inf
+
+	static MetricsRegistry &instance()
+	{
+		static MetricsRegistry s_instance;
+		return s_instance;
+	}
+
+public:
+	/// labels ex) "name=\"monitor.busylevel\""
+	metric_id_t registerCounter(const string_t &name, const string_t &labels = "");
+	metric_id_t registerGauge(const string_t &name, const string_t &labels = "");
+	metric_id_t registerHistogram(const string_t &name, const string_t &labels = "");
+
+	/// 인스턴스마다 한번 호출해서 등록 라벨을 받는다. ex) "name=\"balancer.gameserver\",instance=\"1\""
+	/// 같은 이름의 인스턴스가 여러개여도 지표가 섞이지 않도록 이름별 순번을 붙인다.
+	string_t instanceLabels(const string_t &name);
+
+	/// 스레드 시작시 호출하여 스레드 전용 shard를 만든다. 여러번 호출해도 한번만 만든다.
+	void attachThread()
+	{
+		thread_shard_t *&thread_shard = threadShard();
+		if (!thread_shard)
+		{
+			thread_shard = createShard();
+		}
+	}
+
+	bool isThreadAttached() const
+	{
+		return nullptr != threadShard();
+	}
+
+public:
+	void addCounter(metric_id_t id, uint64_t value = 1)
+	{
+		if (id >= MAX_COUNTER_COUNT)
+		{
+			return;
+		}
+		thread_shard_t *thread_shard = threadShard();
+		if (!thread_shard)
+		{
+			m_shared_shard.m_counters[id].fetch_add(value, std::memory_order_relaxed);
+			return;
+		}
+		// 한 스레드만 쓰는 shard이므로 lock 명령 없이 누적한다.
+		auto &counter = thread_shard->m_counters[id];
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	void setGauge(metric_id_t id, double value)
+	{
+		if (id >= MAX_GAUGE_COUNT)
+		{
+			return;
+		}
+		m_gauges[id].store(value, std::memory_order_relaxed);
+	}
+
+	void addGauge(metric_id_t id, double value)
+	{
+		if (id >= MAX_GAUGE_COUNT)
+		{
+			return;
+		}
+		double current = m_gauges[id].load(std::memory_order_relaxed);
+		while (!m_gauges[id].compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	void observe(metric_id_t id, uint64_t value)
+	{
+		if (id >= MAX_HISTOGRAM_COUNT)
+		{
+			return;
+		}
+		uint32_t bucket = (0 == value) ? 0 : 64 - countLeadingZero64(value);
+		bucket = std::min(bucket, HISTOGRAM_BUCKET_COUNT - 1);
+
+		thread_shard_t *thread_shard = threadShard();
+		if (!thread_shard)
+		{
+			m_shared_shard.m_histogram_buckets[id][bucket].fetch_add(1, std::memory_order_relaxed);
+			m_shared_shard.m_histogram_sums[id].fetch_add(value, std::memory_order_relaxed);
+			return;
+		}
+		auto &bucket_count = thread_shard->m_histogram_buckets[id][bucket];
+		bucket_count.store(bucket_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		auto &sum = thread_shard->m_histogram_sums[id];
+		sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+public:
+	/// 모든 지표를 prometheus text 형식으로 출력한다. 내보내기 스레드에서 호출
+	void exportText(_out string_t &output);
+
+private:
+	MetricsRegistry();
+
+	struct thread_shard_t
+	{
+		std::atomic<uint64_t> m_counters[MAX_COUNTER_COUNT];
+		std::atomic<uint64_t> m_histogram_buckets[MAX_HISTOGRAM_COUNT][HISTOGRAM_BUCKET_COUNT];
+		std::atomic<uint64_t> m_histogram_sums[MAX_HISTOGRAM_COUNT];
+	};
+
+	struct metric_info_t
+	{
+		string_t m_name;
+		string_t m_labels;
+	};
+
+	static thread_shard_t *&threadShard()
+	{
+		static thread_local thread_shard_t *s_shard = nullptr;
+		return s_shard;
+	}
+
+	thread_shard_t *createShard();
+	static void clearShard(thread_shard_t &thread_shard);
+
+	metric_id_t registerMetric(std::vector<metric_info_t> &infos, uint32_t max_count, const string_t &name, const string_t &labels);
+
+private:
+	std::mutex m_register_mutex;
+	std::map<string_t, metric_id_t> m_metric_ids; ///< type:name{labels} -> id
+	std::map<string_t, uint32_t> m_instance_counts; ///< name -> 발급한 인스턴스 수
+	std::vector<metric_info_t> m_counter_infos;
+	std::vector<metric_info_t> m_gauge_infos;
+	std::vector<metric_info_t> m_histogram_infos;
+
+	std::atomic<double> m_gauges[MAX_GAUGE_COUNT];
+
+	std::mutex m_shards_mutex;
+	std::vector<thread_shard_t *> m_shards; ///< 스레드가 끝나도 누적값 유지를 위해 해제하지 않는다. m_shared_shard 포함
+	thread_shard_t m_shared_shard;			///< attachThread 하지 않은 스레드용
+};
+
+/**
+주기적으로 MetricsRegistry를 내보낸다.
+- 파일 경로 : 임시파일에 쓰고 rename 하여 읽는 쪽이 항상 완성된 내용을 보게 한다.
+- "unix:" 로 시작하는 경로 : 해당 unix socket에 접속해서 한번 쓰고 끊는다.
+*/
+class MetricsExporter
+	: public LoggerBaseInfo
+{
+public:
+	MetricsExporter()
+	{
+		setDefaultLoggerName("monitor.metrics");
+	}
+
+	~MetricsExporter()
+	{
+		stop();
+	}
+
+public:
+	void start(const string_t &target_path, float interval_sec);
+	void stop();
+
+	/// 한번 내보내기, 주기와 상관없이 호출 가능
+	gplat::Result exportOnce();
+
+private:
+	void run();
+
+private:
+	string_t m_target_path;
+	float m_interval_sec{10.0f};
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_stop_cond;
+	bool m_stop{false};
+
+	string_t m_buffer;
+};
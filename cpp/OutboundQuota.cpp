@@ -0,0 +1,126 @@
+//
+
+#include "preheader.h"
+
+#include "OutboundQuota.h"
+#include "CompositeBusyLevel.h"
+
+std::atomic<int64_t> OutboundQuota::s_total_pending_bytes{0};
+
+outbound_result_e::TYPE OutboundQuota::admit(uint32_t bytes, send_priority_e::TYPE priority, uint64_t coalesce_key, const send_func_t &send_func)
+{
+	clock_t::time_point now = clock_t::now();
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		if (isStalled(now))
+		{
+			return disconnect();
+		}
+
+		releaseCoalesced();
+		if (m_pending.empty() && !m_flushing && (0 == m_inflight_bytes || m_inflight_bytes + bytes <= m_param.m_socket_window_bytes))
+		{
+			m_inflight_bytes += bytes;
+		}
+		else
+		{
+			bool over_packet_budget = m_pending.size() >= m_param.m_max_pending_packets;
+			if (send_priority_e::low == priority && (m_congested || over_packet_budget))
+			{
+				if (0 == coalesce_key)
+				{
+					MetricsRegistry::instance().addCounter(metricIds().m_drop_id);
+					return outbound_result_e::dropped;
+				}
+				auto coalesced_it = m_coalesced.find(coalesce_key);
+				int64_t replaced_bytes = (coalesced_it == m_coalesced.end()) ? 0 : coalesced_it->second.m_bytes;
+				m_coalesced[coalesce_key] = pending_t{bytes, send_func};
+				addBacklog(0, static_cast<int64_t>(bytes) - replaced_bytes);
+				MetricsRegistry::instance().addCounter(metricIds().m_coalesce_id);
+				return outbound_result_e::coalesced;
+			}
+			if (over_packet_budget || m_pending_bytes + bytes > m_param.m_max_pending_bytes)
+			{
+				return disconnect();
+			}
+			enqueue(bytes, send_func);
+			updateCongestion(now);
+			return outbound_result_e::queued;
+		}
+	}
+
+	// 송신 함수는 잠금 밖에서 호출한다.
+	send_func();
+	return outbound_result_e::sent;
+}
+
+outbound_result_e::TYPE OutboundQuota::flush(uint32_t kernel_queued_bytes, _out std::vector<send_func_t> &out_send_funcs)
+{
+	clock_t::time_point now = clock_t::now();
+	spin_mutex_t::scoped_lock lock(m_mutex);
+	m_inflight_bytes = kernel_queued_bytes;
+	releaseCoalesced();
+
+	// 커널 큐가 비어있으면 window보다 큰 메시지도 하나는 넘긴다.
+	int64_t flushed_bytes = 0;
+	while (!m_pending.empty() && (0 == m_inflight_bytes || m_inflight_bytes + m_pending.front().m_bytes <= m_param.m_socket_window_bytes))
+	{
+		m_inflight_bytes += m_pending.front().m_bytes;
+		flushed_bytes += m_pending.front().m_bytes;
+		out_send_funcs.push_back(std::move(m_pending.front().m_send_func));
+		m_pending.pop_front();
+	}
+	addBacklog(-flushed_bytes, 0);
+	updateCongestion(now);
+	if (isStalled(now))
+	{
+		out_send_funcs.clear();
+		return disconnect();
+	}
+
+	m_flushing = !out_send_funcs.empty();
+	return outbound_result_e::sent;
+}
+
+void OutboundQuota::releaseCoalesced()
+{
+	if (m_congested || m_coalesced.empty())
+	{
+		return;
+	}
+
+	for (auto &coalesced_pair : m_coalesced)
+	{
+		m_pending.push_back(std::move(coalesced_pair.second));
+	}
+	m_coalesced.clear();
+	addBacklog(m_coalesced_bytes, -static_cast<int64_t>(m_coalesced_bytes));
+}
+
+outbound_result_e::TYPE OutboundQuota::disconnect()
+{
+	MetricsRegistry::instance().addCounter(metricIds().m_disconnect_id);
+	return outbound_result_e::disconnect;
+}
+
+bool OutboundQuota::sampleSendBacklog(CompositeBusyLevel &composite_busy_level)
+{
+	double total_pending_bytes = static_cast<double>(totalPendingBytes());
+	MetricsRegistry::instance().setGauge(metricIds().m_pending_bytes_id, total_pending_bytes);
+	return composite_busy_level.sample(busy_resource_e::SEND_BACKLOG, static_cast<float>(total_pending_bytes));
+}
+
+const OutboundQuota::metric_ids_t &OutboundQuota::metricIds()
+{
+	static const metric_ids_t s_metric_ids = []()
+	{
+		auto &registry = MetricsRegistry::instance();
+		metric_ids_t metric_ids;
+		metric_ids.m_drop_id = registry.registerCounter("session_send_drop_total");
+		metric_ids.m_coalesce_id = registry.registerCounter("session_send_coalesce_total");
+		metric_ids.m_disconnect_id = registry.registerCounter("session_send_stall_disconnect_total");
+		metric_ids.m_pending_bytes_id = registry.registerGauge("session_send_pending_bytes");
+		return metric_ids;
+	}();
+	return s_metric_ids;
+}
@@ -0,0 +1,225 @@
+//
+#pragma once
+
+#include "Concurrency.h"
+#include "MetricsRegistry.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+class CompositeBusyLevel;
+
+struct send_priority_e
+{
+	enum TYPE : uint8_t
+	{
+		low,	// 상태 갱신 등, 혼잡시 버리거나 최신값만 유지
+		normal, // 혼잡해도 보내지만 정체가 계속되면 접속을 끊는다.
+		high	// 시스템 알림 등
+	};
+};
+
+struct outbound_result_e
+{
+	enum TYPE : uint8_t
+	{
+		sent,	   // 소켓에 바로 넘겼다.
+		queued,	   // 세션 대기열에 넣었다. flush에서 소켓에 넘긴다.
+		coalesced, // 혼잡 해소 후 키별 최신값만 보낸다.
+		dropped,
+		disconnect // 예산 초과 또는 정체 시간 초과, 세션을 끊어야 한다.
+	};
+};
+
+/**
+세션별 송신 예산
+- 세션이 소켓에 넘기기 전 메시지를 자기 대기열에 두고 대기 바이트/패킷 수를 직접 센다.
+  커널 송신 큐(SIOCOUTQ)는 SO_SNDBUF 이상 쌓이지 않으므로 대기량으로 쓰지 않고, 소켓에 더 넘길 수 있는지만 본다.
+- 대기열이 비어있고 소켓에 넘긴 양이 m_socket_window_bytes 안이면 바로 보낸다. 아니면 대기열에 넣고 세션이 flush 타이머를 건다.
+- flush는 타이머 한번에 커널 큐를 한번 재서 빈 만큼 대기열에서 꺼낸다. 송신마다 재지 않는다.
+- 대기 바이트가 high watermark 이상이면 혼잡 상태, low 우선순위는 coalesce_key가 있으면 키별 최신값만 보관하고 없으면 버린다.
+  low watermark 이하로 내려가면 보관된 최신값을 대기열 뒤에 붙인다.
+- 대기 패킷 수가 m_max_pending_packets이면 low는 버리고 나머지는 disconnect, 대기 바이트가 m_max_pending_bytes를 넘어도 disconnect
+- 혼잡이 m_stall_disconnect_sec 이상 계속되면 disconnect
+- 모든 세션의 대기 바이트 합계를 유지하여 지표와 SEND_BACKLOG busy level 샘플로 사용한다.
+*/
+class OutboundQuota
+{
+public:
+	typedef std::function<void()> send_func_t;
+	typedef std::chrono::steady_clock clock_t;
+
+	struct param_t
+	{
+		uint32_t m_low_watermark_bytes{16 * 1024};
+		uint32_t m_high_watermark_bytes{64 * 1024};
+		uint32_t m_max_pending_bytes{1024 * 1024}; ///< hard cap
+		uint32_t m_max_pending_packets{4096};
+		uint32_t m_socket_window_bytes{64 * 1024}; ///< 커널 큐에 넘겨둘 최대 바이트, SO_SNDBUF 이하로
+		uint32_t m_flush_interval_msec{2};
+		float m_stall_disconnect_sec{10.0f};
+	};
+
+public:
+	OutboundQuota() = default;
+
+	~OutboundQuota()
+	{
+		// 세션과 함께 사라지므로 합계에서 뺀다.
+		s_total_pending_bytes.fetch_sub(m_pending_bytes + m_coalesced_bytes, std::memory_order_relaxed);
+	}
+
+	void setParam(const param_t &param)
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		m_param = param;
+	}
+
+	uint32_t flushIntervalMsec()
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		return m_param.m_flush_interval_msec;
+	}
+
+	/// bytes : 메시지 크기, sent이면 send_func를 호출한 후 돌려준다. queued/coalesced이면 scheduleFlush 후 flush 타이머를 건다.
+	outbound_result_e::TYPE admit(uint32_t bytes, send_priority_e::TYPE priority, uint64_t coalesce_key, const send_func_t &send_func);
+
+	/// flush 타이머에서 호출, kernel_queued_bytes : 소켓 송신 큐 측정값
+	/// 소켓에 넘길 송신 함수를 돌려주며 호출자가 모두 호출한 후 endFlush를 부른다.
+	outbound_result_e::TYPE flush(uint32_t kernel_queued_bytes, _out std::vector<send_func_t> &out_send_funcs);
+
+	/// 대기중인 메시지가 있고 타이머가 걸려있지 않으면 true, 호출자가 타이머를 건다.
+	bool scheduleFlush()
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		if (m_flush_scheduled || !hasBacklog())
+		{
+			return false;
+		}
+		m_flush_scheduled = true;
+		return true;
+	}
+
+	/// flush 마무리, 아직 대기중인 메시지가 있으면 true(타이머 유지), 없으면 타이머를 내린다.
+	bool endFlush()
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		m_flushing = false;
+		m_flush_scheduled = hasBacklog();
+		return m_flush_scheduled;
+	}
+
+	/// 세션 종료시 대기중인 메시지를 버린다.
+	void clear()
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		m_pending.clear();
+		m_coalesced.clear();
+		addBacklog(-static_cast<int64_t>(m_pending_bytes), -static_cast<int64_t>(m_coalesced_bytes));
+		m_congested = false;
+	}
+
+	uint32_t pendingBytes() const
+	{
+		return m_pending_bytes;
+	}
+
+	uint32_t pendingPackets() const
+	{
+		return static_cast<uint32_t>(m_pending.size());
+	}
+
+	bool isCongested() const
+	{
+		return m_congested;
+	}
+
+public:
+	/// 모든 세션의 대기 바이트 합계(보관된 최신값 포함)
+	static int64_t totalPendingBytes()
+	{
+		return s_total_pending_bytes.load(std::memory_order_relaxed);
+	}
+
+	/// 합계를 지표와 busy level에 반영한다. BusyResourceSampler가 주기적으로 호출, 단계가 바뀌면 true
+	static bool sampleSendBacklog(CompositeBusyLevel &composite_busy_level);
+
+	struct metric_ids_t
+	{
+		metric_id_t m_drop_id;
+		metric_id_t m_coalesce_id;
+		metric_id_t m_disconnect_id;
+		metric_id_t m_pending_bytes_id;
+	};
+	static const metric_ids_t &metricIds();
+
+private:
+	struct pending_t
+	{
+		uint32_t m_bytes{0};
+		send_func_t m_send_func;
+	};
+
+	// 이하 m_mutex 잠근 상태에서 호출
+	bool hasBacklog() const
+	{
+		return !m_pending.empty() || (!m_congested && !m_coalesced.empty());
+	}
+
+	void addBacklog(int64_t pending_delta, int64_t coalesced_delta)
+	{
+		m_pending_bytes = static_cast<uint32_t>(m_pending_bytes + pending_delta);
+		m_coalesced_bytes = static_cast<uint32_t>(m_coalesced_bytes + coalesced_delta);
+		s_total_pending_bytes.fetch_add(pending_delta + coalesced_delta, std::memory_order_relaxed);
+	}
+
+	void updateCongestion(clock_t::time_point now)
+	{
+		if (m_pending_bytes >= m_param.m_high_watermark_bytes)
+		{
+			if (!m_congested)
+			{
+				m_congested_since = now;
+			}
+			m_congested = true;
+		}
+		else if (m_pending_bytes <= m_param.m_low_watermark_bytes)
+		{
+			m_congested = false;
+		}
+	}
+
+	bool isStalled(clock_t::time_point now) const
+	{
+		return m_congested && now - m_congested_since >= std::chrono::duration<float>(m_param.m_stall_disconnect_sec);
+	}
+
+	void enqueue(uint32_t bytes, const send_func_t &send_func)
+	{
+		m_pending.push_back(pending_t{bytes, send_func});
+		addBacklog(bytes, 0);
+	}
+
+	/// 혼잡이 풀렸으면 보관된 최신값을 대기열 뒤에 붙인다.
+	void releaseCoalesced();
+
+	outbound_result_e::TYPE disconnect();
+
+private:
+	spin_mutex_t m_mutex;
+	param_t m_param;
+	std::deque<pending_t> m_pending; ///< 소켓에 넘기지 않은 메시지, 순서대로
+	uint32_t m_pending_bytes{0};
+	std::map<uint64_t, pending_t> m_coalesced; ///< coalesce_key -> 최신 메시지
+	uint32_t m_coalesced_bytes{0};
+	uint32_t m_inflight_bytes{0}; ///< 마지막 측정한 커널 큐 + 이후 소켓에 넘긴 바이트
+	bool m_congested{false};
+	clock_t::time_point m_congested_since;
+	bool m_flushing{false};		   ///< flush가 꺼낸 메시지를 넘기는 중, 순서를 지키도록 바로 보내지 않는다.
+	bool m_flush_scheduled{false}; ///< 세션 flush 타이머가 걸려 있다.
+
+	static std::atomic<int64_t> s_total_pending_bytes;
+};
@@ -2,39 +2,185 @@
 #pragma once
 
 #include <libGen/cpp/base/BusyLevel.h>
+#include "AsyncLogSink.h"
+#include "MetricsRegistry.h"
 #include <msg_gen_manage_types.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <set>
+#include <unordered_map>
 class Session;
 
 // 게임서버 할당 기준
 // - 혼잡도가 가장 낮은 녀석
-// - 최소인원 미만인 녀석들 중 가장 큰 녀석
-// - 최소인원 이상인 녀석들 중 가장 작은 녀석
+// - 사용률(인원 / (m_base_fill_user_count * 용량 가중치))이 1 미만인 녀석들 중 가장 큰 녀석
+// - 모두 1 이상이면 가장 작은 녀석
+// - 위 기준은 기존 두번 정렬(혼잡도 내림, 인원 내림 -> 가득 찼으면 혼잡도 내림, 인원 오름)과 같은 결과다.
+// - (혼잡도, 가중치당 인원, server_id) 정렬 색인으로 O(log n)에 고른다.
+// - 객체의 인원/혼잡도를 직접 바꿨으면 updateServer로 알려준다. 고른 후보는 현재값을 다시 읽어 색인과 다르면 다시 고른다.
+// - 용량 가중치는 등록시 지정하거나 learnCapacityWeight로 BusyLevel 평균값 대비 인원에서 추정한다.
+// lease 할당(alloc(lease, timeout)) 기준
+// - 서버 보고 인원은 늦게 반영되므로 할당 즉시 lease로 인원을 잡아 사용률에 포함한다.
+// - 확정되지 않은 lease는 timeout 후 timer wheel에서 만료된다.
+// - 확정된 lease는 서버 보고 인원이 늘어난 만큼 차감하며, 보고가 없어도 m_lease_reconcile_sec 후 빠진다.
+// affinity 할당(allocByAffinity) 기준
+// - 길드, 파티, 계정등 키를 consistent hash ring에 올려 같은 키는 같은 서버로 보낸다.
+// - 입장 불가(BUSY_WARN 미만)이거나 부하 상한 이상인 서버는 건너뛰고 ring의 다음 서버로 넘긴다.
+// - 부하 상한의 평균 인원은 보고 인원 합계를 유지하여 구하며, 검사한 서버의 보고 인원은 그때 다시 읽어 합계에 반영한다.
+// - 서버 등록/해제시 해당 서버의 가상노드만 추가/제거하므로 다른 키는 이동하지 않는다.
 template <typename BALANCE_OBJECT>
 class ServerBalancer
 	: public LoggerBaseInfo
 {
+public:
+	struct balance_lease_t
+	{
+		uint64_t m_lease_id{0};
+		int32_t m_server_id{0};
+	};
+
+	static const uint32_t LEASE_WHEEL_SIZE = 256;
+	static const uint32_t STATUS_MAGIC = 0x53424C42; // "BLBS"
+	static const uint16_t STATUS_VERSION = 1;
+
+#pragma pack(push, 1)
+	struct status_header_t
+	{
+		uint32_t m_magic;
+		uint16_t m_version;
+		uint16_t m_record_size;
+		uint32_t m_server_count;
+		int32_t m_base_fill_user_count;
+		int32_t m_level_counts[BusyLevel_e::_END];
+	};
+
+	struct status_record_t
+	{
+		int32_t m_server_id;
+		int32_t m_user_count;
+		int32_t m_pending_lease_count;
+		int32_t m_confirmed_lease_count;
+		float m_capacity_weight;
+		uint8_t m_busy_level;
+		uint8_t m_reserved[3];
+	};
+#pragma pack(pop)
+
 public:
 	ServerBalancer()
 	{
 		setDefaultLoggerName("balancer.gameserver");
 	}
 
+	/// 운영에 쓰는 인스턴스가 한번 호출한다. 호출하지 않은 인스턴스(임시, 테스트)는 지표를 남기지 않는다.
+	void registerMetrics(const string_t &name)
+	{
+		if (MetricsRegistry::INVALID_METRIC_ID != m_alloc_metric_id)
+		{
+			return;
+		}
+		auto &registry = MetricsRegistry::instance();
+		string_t labels = registry.instanceLabels(name);
+		m_alloc_metric_id = registry.registerCounter("balancer_alloc_total", labels);
+		m_alloc_fail_metric_id = registry.registerCounter("balancer_alloc_fail_total", labels);
+		m_alloc_fill_metric_id = registry.registerHistogram("balancer_alloc_fill_user_count", labels);
+		m_server_count_metric_id = registry.registerGauge("balancer_server_count", labels);
+		m_affinity_alloc_metric_id = registry.registerCounter("balancer_affinity_alloc_total", labels);
+		m_affinity_spill_metric_id = registry.registerCounter("balancer_affinity_spill_total", labels);
+		m_lease_metric_id = registry.registerCounter("balancer_lease_total", labels);
+		m_lease_expired_metric_id = registry.registerCounter("balancer_lease_expired_total", labels);
+		m_overbook_avoided_metric_id = registry.registerCounter("balancer_overbook_avoided_total", labels);
+		m_lease_pending_metric_id = registry.registerGauge("balancer_lease_pending", labels);
+	}
+
 public:
 	void changeServerBusyLevel(uint16_t server_id, BusyLevel_e::TYPE busy_level)
 	{
-		boost::shared_ptr<BALANCE_OBJECT> balance_object;
-		if (findObject(server_id, balance_object))
+		auto it = m_server_entries.find(server_id);
+		if (it != m_server_entries.end())
+		{
+			it->second.m_balance_object->m_busy_level = busy_level;
+			refreshEntry(it->second);
+		}
+	}
+
+	/// 서버 인원(balanceKeyUserCount) 또는 혼잡도가 바뀐 후 호출하여 색인에 반영한다.
+	void updateServer(int32_t server_id)
+	{
+		auto it = m_server_entries.find(server_id);
+		if (it != m_server_entries.end())
+		{
+			refreshEntry(it->second);
+		}
+	}
+
+	/// 모든 서버의 현재값을 다시 읽어 색인에 반영한다. 일괄 재배치 전이나 보고 인원을 모아서 받은 후 호출
+	void refreshServers()
+	{
+		for (auto &server_entry_pair : m_server_entries)
+		{
+			refreshEntry(server_entry_pair.second);
+		}
+	}
+
+	gplat::Result setCapacityWeight(int32_t server_id, float capacity_weight)
+	{
+		gplat::Result gen_result;
+		auto it = m_server_entries.find(server_id);
+		if (it == m_server_entries.end())
+		{
+			return gen_result.setFail(sformat("server_id:{0} not exist", server_id));
+		}
+		setEntryCapacityWeight(it->second, clampCapacityWeight(capacity_weight));
+		refreshEntry(it->second);
+		return gen_result.setOk();
+	}
+
+	float capacityWeight(int32_t server_id)
+	{
+		auto it = m_server_entries.find(server_id);
+		if (it == m_server_entries.end())
 		{
-			balance_object->m_busy_level = busy_level;
+			return 1.0f;
 		}
+		return it->second.m_capacity_weight;
+	}
+
+	// 해당 서버의 BusyLevel 평균값이 WARN 기준에 닿는 인원을 추정하여 가중치를 서서히 맞춘다.
+	// 부하가 인원에 비례한다고 보고, 인원이 적을 때는 추정이 부정확하므로 반영하지 않는다.
+	// 기준값은 busyThreshold로 읽어 PERCENT 방식이어도 평균값과 같은 단위로 비교한다.
+	void learnCapacityWeight(int32_t server_id, const BusyLevel &busy_level)
+	{
+		auto it = m_server_entries.find(server_id);
+		if (it == m_server_entries.end())
+		{
+			return;
+		}
+		int32_t user_count = it->second.m_balance_object->balanceKeyUserCount();
+		float average_value = busy_level.recentAverageValue();
+		float warn_value = busy_level.busyThreshold(BusyLevel_e::BUSY_WARN);
+		if (average_value <= 0.0f || warn_value <= 0.0f || user_count < m_base_fill_user_count / 4)
+		{
+			return;
+		}
+
+		float estimated_weight = (static_cast<float>(user_count) * warn_value / average_value) / static_cast<float>(m_base_fill_user_count);
+		float capacity_weight = it->second.m_capacity_weight;
+		setEntryCapacityWeight(it->second, clampCapacityWeight(capacity_weight + (estimated_weight - capacity_weight) * m_capacity_learn_rate));
+		refreshEntry(it->second);
 	}
 
-	// 모두가 특정 상태 이하이면
-	bool allBusyLevelUnder(BusyLevel_e::TYPE busy_level)
+	// 모두가 특정 상태 이하이면, 혼잡도별 서버 수로 판단한다(서버 수와 무관하게 단계 수만큼).
+	// 혼잡도별 서버 수는 등록/해제/changeServerBusyLevel(updateServer)에서 갱신한다.
+	bool allBusyLevelUnder(BusyLevel_e::TYPE busy_level) const
 	{
-		for (boost::shared_ptr<BALANCE_OBJECT> info : m_balance_objects)
+		for (int32_t level = busy_level + 1; level < BusyLevel_e::_END; ++level)
 		{
-			if (info->m_busy_level > busy_level) ///하나라도 크면
+			if (0 < m_level_counts[level]) ///하나라도 크면
 			{
 				return false;
 			}
@@ -42,8 +188,13 @@ public:
 		return true;
 	}
 
+	int32_t busyLevelCount(BusyLevel_e::TYPE busy_level) const
+	{
+		return m_level_counts[busy_level];
+	}
+
 public:
-	gplat::Result registerServer(boost::shared_ptr<BALANCE_OBJECT> balance_object)
+	gplat::Result registerServer(boost::shared_ptr<BALANCE_OBJECT> balance_object, float capacity_weight = 1.0f)
 	{
 		gplat::Result gen_result;
 		boost::shared_ptr<BALANCE_OBJECT> exist_balance_object;
@@ -53,14 +204,23 @@ public:
 		}
 		balance_object->setBusyLevel(BusyLevel_e::BUSY_IDLE);
 		m_balance_objects.push_back(balance_object);
-		LOG_TRACE("registered: balanceKeyServerId:{0}", balance_object->balanceKeyServerId());
+		server_entry_t &server_entry = m_server_entries[balance_object->balanceKeyServerId()];
+		server_entry = server_entry_t{balance_object, clampCapacityWeight(capacity_weight), balance_object->balanceKeyUserCount()};
+		m_total_reported_user_count += server_entry.m_reported_user_count;
+		m_total_capacity_weight += server_entry.m_capacity_weight;
+		addHashRing(server_entry);
+		server_entry.m_index_key = makeIndexKey(server_entry);
+		m_server_index.insert(server_entry.m_index_key);
+		++m_level_counts[server_entry.m_index_key.m_busy_level];
+		MetricsRegistry::instance().setGauge(m_server_count_metric_id, static_cast<double>(m_balance_objects.size()));
+		ASYNC_LOG_TRACE("balancer.gameserver", "registered: balanceKeyServerId:{0}", balance_object->balanceKeyServerId());
 
 		return gen_result.setOk();
 	}
 
 	void unregisterServer(int32_t server_id)
 	{
-		LOG_TRACE("try unregister: balanceKeyServerId:{0}", server_id);
+		ASYNC_LOG_TRACE("balancer.gameserver", "try unregister: balanceKeyServerId:{0}", server_id);
 
 		auto it = std::remove_if(m_balance_objects.begin(), m_balance_objects.end(),
 								 [server_id](boost::shared_ptr<BALANCE_OBJECT> balance_object) -> bool
@@ -70,9 +230,21 @@ public:
 
 		if (it != m_balance_objects.end())
 		{
-			m_balance_objects.erase(it);
+			m_balance_objects.erase(it, m_balance_objects.end());
+		}
+		removeHashRing(server_id);
+		auto entry_it = m_server_entries.find(server_id);
+		if (entry_it != m_server_entries.end())
+		{
+			// 남은 lease는 만료될 때 정리된다.
+			m_server_index.erase(entry_it->second.m_index_key);
+			--m_level_counts[entry_it->second.m_index_key.m_busy_level];
+			m_total_reported_user_count -= entry_it->second.m_reported_user_count;
+			m_total_capacity_weight -= entry_it->second.m_capacity_weight;
+			m_server_entries.erase(entry_it);
 		}
 		m_dedicated_object.reset(); //무조건 리셋
+		MetricsRegistry::instance().setGauge(m_server_count_metric_id, static_cast<double>(m_balance_objects.size()));
 	}
 
 	int32_t serverCount()
@@ -80,104 +252,295 @@ public:
 		return static_cast<int32_t>(m_balance_objects.size());
 	}
 
-public:
-	boost::shared_ptr<BALANCE_OBJECT> alloc()
+	bool hasServer(int32_t server_id) const
 	{
-		auto base_fill_user_count = m_base_fill_user_count;
-		// 기준선 미만으로 먼저 정렬을 해서 원하는게 없을 경우 기준선 이상으로 정렬을 수행한다.
-		boost::shared_ptr<BALANCE_OBJECT> balance_object;
+		return m_server_entries.find(server_id) != m_server_entries.end();
+	}
 
-		// dedicated_object // base_fill_user_count보다 높으면 통과
-		if (m_dedicated_object && m_dedicated_object->balanceKeyUserCount() < base_fill_user_count)
+	// 입장 가능한(BUSY_WARN 이상) 서버들에 alloc으로 더 넣을 수 있는 인원 합계, 대기열 입장 허용량 계산에 사용
+	// alloc과 같은 상한(allocLimitUserCount)을 쓰며, lease로 잡아둔 인원도 사용중으로 본다.
+	// 상한이 없으면(m_max_fill_ratio <= 0) 입장 가능한 서버가 하나라도 있는 한 INT32_MAX
+	int32_t fillHeadroom()
+	{
+		int64_t headroom = 0;
+		for (auto &server_entry_pair : m_server_entries)
 		{
-			return m_dedicated_object;
+			const server_entry_t &server_entry = server_entry_pair.second;
+			if (server_entry.m_balance_object->busyLevel() < BusyLevel_e::BUSY_WARN)
+			{
+				continue;
+			}
+			if (m_max_fill_ratio <= 0.0f)
+			{
+				return std::numeric_limits<int32_t>::max();
+			}
+			headroom += std::max(0, allocLimitUserCount(server_entry_pair.first) - effectiveUserCount(server_entry));
 		}
+		return static_cast<int32_t>(std::min<int64_t>(headroom, std::numeric_limits<int32_t>::max()));
+	}
 
-		std::sort(m_balance_objects.begin(), m_balance_objects.end(),
-				  [&](boost::shared_ptr<BALANCE_OBJECT> left, boost::shared_ptr<BALANCE_OBJECT> right) -> bool
-				  {
-					  if (left->busyLevel() > right->busyLevel()) /// 상태값이 큰녀석을 앞으로 if first is equal then second key
-					  {
-						  return true;
-					  }
-					  else if (left->busyLevel() < right->busyLevel())
-					  {
-						  return false;
-					  }
-					  // file_user_count가 미만인 경우가 우선
-					  else if (left->balanceKeyUserCount() > right->balanceKeyUserCount()) // currentCount가 큰 녀석을 앞으로
-					  {
-						  return true;
-					  }
-					  else if (left->balanceKeyUserCount() < right->balanceKeyUserCount())
-					  {
-						  return false;
-					  }
-					  else if (left->balanceKeyServerId() < right->balanceKeyServerId()) // server_id()가 작은 녀석을 앞으로
-					  {
-						  return true;
-					  }
-					  return false;
-				  });
+	// alloc이 서버에 넣을 수 있는 최대 인원, 상한이 없으면 INT32_MAX
+	int32_t allocLimitUserCount(int32_t server_id)
+	{
+		if (m_max_fill_ratio <= 0.0f)
+		{
+			return std::numeric_limits<int32_t>::max();
+		}
+		return static_cast<int32_t>(static_cast<float>(fillUserCount(server_id)) * m_max_fill_ratio);
+	}
 
-		// 혼잡도가 높거나 기준값 이상으로 채워져있는 경우 조건에 만족하는 것이 없으므로 기준값 이상의 값을 찾도록 한다.
-		bool not_exist = false;
-		balance_object = m_balance_objects.front();
+	// 가중치를 반영한 서버별 기준인원
+	int32_t fillUserCount(int32_t server_id)
+	{
+		return static_cast<int32_t>(static_cast<float>(m_base_fill_user_count) * capacityWeight(server_id));
+	}
 
-		if (!balance_object)
+public:
+	boost::shared_ptr<BALANCE_OBJECT> alloc()
+	{
+		if (m_server_entries.empty())
 		{
-			LOG_ERROR("object not exist. m_balance_objects empty.");
+			ASYNC_LOG_ERROR("balancer.gameserver", "object not exist. m_balance_objects empty.");
+			MetricsRegistry::instance().addCounter(m_alloc_fail_metric_id);
 			return boost::shared_ptr<BALANCE_OBJECT>();
 		}
 
-		if (balance_object->busyLevel() < BusyLevel_e::BUSY_WARN || balance_object->balanceKeyUserCount() >= m_base_fill_user_count)
-		{
-			not_exist = true;
-		}
-
-		if (not_exist)
-		{
-			std::sort(m_balance_objects.begin(), m_balance_objects.end(),
-					  [&](boost::shared_ptr<BALANCE_OBJECT> left, boost::shared_ptr<BALANCE_OBJECT> right) -> bool
-					  {
-						  if (left->busyLevel() > right->busyLevel()) /// 상태값이 큰녀석을 앞으로 if first is equal then second key
-						  {
-							  return true;
-						  }
-						  else if (left->busyLevel() < right->busyLevel())
-						  {
-							  return false;
-						  }
-						  // file_user_count가 이상 인 경우가 우선
-						  else if (left->balanceKeyUserCount() < right->balanceKeyUserCount()) // currentCount가 작은 녀석을 앞으로
-						  {
-							  return true;
-						  }
-						  else if (left->balanceKeyUserCount() > right->balanceKeyUserCount())
-						  {
-							  return false;
-						  }
-						  else if (left->balanceKeyServerId() < right->balanceKeyServerId()) // server_id()가 작은 녀석을 앞으로
-						  {
-							  return true;
-						  }
-						  return false;
-					  });
+		// dedicated_object // 입장 가능하고 기준 사용률 미만이면 통과
+		// refreshEntry가 보고 인원을 다시 읽어(syncReportedUserCount) 보고에 반영된 확정 lease를 빼야 이중으로 세지 않는다.
+		if (m_dedicated_object && BusyLevel_e::BUSY_WARN <= m_dedicated_object->busyLevel())
+		{
+			auto dedicated_it = m_server_entries.find(m_dedicated_object->balanceKeyServerId());
+			if (dedicated_it != m_server_entries.end())
+			{
+				refreshEntry(dedicated_it->second);
+				if (utilization(dedicated_it->second) < 1.0)
+				{
+					MetricsRegistry::instance().addCounter(m_alloc_metric_id);
+					MetricsRegistry::instance().observe(m_alloc_fill_metric_id, m_dedicated_object->balanceKeyUserCount());
+					return m_dedicated_object;
+				}
+			}
 		}
 
+		server_entry_t &server_entry = pickCandidate();
+		int32_t server_id = server_entry.m_index_key.m_server_id;
+		boost::shared_ptr<BALANCE_OBJECT> balance_object = server_entry.m_balance_object;
+
 		// 맨앞녀석이 NORMAL이 아니면 쓸수 있는 건 없음.
-		balance_object = m_balance_objects.front();
 		if (balance_object->busyLevel() < BusyLevel_e::BUSY_WARN)
 		{
-			LOG_TRACE("no idle gameserver");
+			ASYNC_LOG_TRACE("balancer.gameserver", "no idle gameserver");
+			MetricsRegistry::instance().addCounter(m_alloc_fail_metric_id);
+			return boost::shared_ptr<BALANCE_OBJECT>();
+		}
+
+		// 사용률이 가장 작은 녀석도 상한이면 모두 가득 참
+		if (effectiveUserCount(server_entry) >= allocLimitUserCount(server_id))
+		{
+			ASYNC_LOG_TRACE("balancer.gameserver", "all gameserver full");
+			MetricsRegistry::instance().addCounter(m_alloc_fail_metric_id);
 			return boost::shared_ptr<BALANCE_OBJECT>();
 		}
 
 		m_dedicated_object = balance_object;
+		MetricsRegistry::instance().addCounter(m_alloc_metric_id);
+		MetricsRegistry::instance().observe(m_alloc_fill_metric_id, balance_object->balanceKeyUserCount());
+
+		return balance_object;
+	}
+
+	// 할당과 동시에 lease로 인원 1을 잡는다. timeout_sec 안에 confirmLease 하지 않으면 만료된다.
+	boost::shared_ptr<BALANCE_OBJECT> alloc(_out balance_lease_t &lease, float timeout_sec)
+	{
+		// 보고 인원만 보면 여유가 있지만 lease를 포함하면 가득 찬 경우, 기존 방식이라면 초과 할당되었을 것
+		if (m_dedicated_object)
+		{
+			int32_t server_id = m_dedicated_object->balanceKeyServerId();
+			if (m_dedicated_object->balanceKeyUserCount() < fillUserCount(server_id) && utilization(server_id) >= 1.0)
+			{
+				MetricsRegistry::instance().addCounter(m_overbook_avoided_metric_id);
+			}
+		}
+
+		boost::shared_ptr<BALANCE_OBJECT> balance_object = alloc();
+		if (!balance_object)
+		{
+			return balance_object;
+		}
 
+		int32_t server_id = balance_object->balanceKeyServerId();
+		lease.m_lease_id = ++m_last_lease_id;
+		lease.m_server_id = server_id;
+
+		m_leases[lease.m_lease_id] = lease_info_t{server_id, false, scheduleLease(lease.m_lease_id, timeout_sec)};
+		server_entry_t &server_entry = m_server_entries[server_id];
+		++server_entry.m_pending_lease_count;
+		refreshEntry(server_entry);
+		++m_lease_pending_count;
+
+		MetricsRegistry::instance().addCounter(m_lease_metric_id);
+		MetricsRegistry::instance().setGauge(m_lease_pending_metric_id, static_cast<double>(m_lease_pending_count));
 		return balance_object;
 	}
 
+	// 실제 입장 완료, 서버 보고 인원에 반영될 때까지 확정 인원으로 유지한다.
+	gplat::Result confirmLease(uint64_t lease_id)
+	{
+		gplat::Result gen_result;
+		auto it = m_leases.find(lease_id);
+		if (it == m_leases.end() || it->second.m_confirmed)
+		{
+			return gen_result.setFail(sformat("lease_id:{0} not pending", lease_id));
+		}
+
+		lease_info_t &lease_info = it->second;
+		lease_info.m_confirmed = true;
+		lease_info.m_expire_tick = scheduleLease(lease_id, m_lease_reconcile_sec);
+		--m_lease_pending_count;
+		MetricsRegistry::instance().setGauge(m_lease_pending_metric_id, static_cast<double>(m_lease_pending_count));
+
+		auto entry_it = m_server_entries.find(lease_info.m_server_id);
+		if (entry_it != m_server_entries.end())
+		{
+			entry_it->second.m_pending_lease_count = std::max(0, entry_it->second.m_pending_lease_count - 1);
+			++entry_it->second.m_confirmed_lease_count;
+		}
+		return gen_result.setOk();
+	}
+
+	// 입장 취소, 잡아둔 인원을 바로 돌려준다.
+	void cancelLease(uint64_t lease_id)
+	{
+		auto it = m_leases.find(lease_id);
+		if (it == m_leases.end())
+		{
+			return;
+		}
+		releaseLease(it->second);
+		m_leases.erase(it);
+	}
+
+	// 주기적으로 호출하여 만료된 lease를 정리한다. elapsed_sec : 이전 호출 이후 경과 시간
+	int32_t updateLeases(float elapsed_sec)
+	{
+		int32_t expired_count = 0;
+		m_lease_elapsed_sec += elapsed_sec;
+		while (m_lease_elapsed_sec >= m_lease_tick_sec)
+		{
+			m_lease_elapsed_sec -= m_lease_tick_sec;
+			++m_lease_tick;
+
+			// 같은 슬롯에 다음 바퀴 lease가 섞여 있으므로 이번 tick 것만 꺼낸다.
+			std::vector<uint64_t> &slot = m_lease_wheel[m_lease_tick % LEASE_WHEEL_SIZE];
+			size_t keep_count = 0;
+			for (uint64_t lease_id : slot)
+			{
+				auto it = m_leases.find(lease_id);
+				if (it == m_leases.end())
+				{
+					continue;
+				}
+				if (it->second.m_expire_tick > m_lease_tick)
+				{
+					slot[keep_count++] = lease_id;
+					continue;
+				}
+				if (it->second.m_expire_tick < m_lease_tick)
+				{
+					continue; // 재예약되어 다른 슬롯에 있음
+				}
+
+				if (!it->second.m_confirmed)
+				{
+					++expired_count;
+					MetricsRegistry::instance().addCounter(m_lease_expired_metric_id);
+				}
+				releaseLease(it->second);
+				m_leases.erase(it);
+			}
+			slot.resize(keep_count);
+		}
+
+		if (0 < expired_count)
+		{
+			ASYNC_LOG_DEBUG("balancer.gameserver", "lease expired. count:{0}", expired_count);
+		}
+		return expired_count;
+	}
+
+	int32_t leasePendingCount() const
+	{
+		return m_lease_pending_count;
+	}
+
+	// 같은 affinity_key(guild_db_id, party_id, account_db_id 등)는 가능한 같은 서버로 할당한다.
+	// 부하 상한 : max(m_base_fill_user_count, 가중치당 평균 인원 * m_affinity_load_factor) * 가중치
+	boost::shared_ptr<BALANCE_OBJECT> allocByAffinity(uint64_t affinity_key)
+	{
+		if (m_hash_ring.empty())
+		{
+			ASYNC_LOG_ERROR("balancer.gameserver", "object not exist. m_balance_objects empty.");
+			MetricsRegistry::instance().addCounter(m_alloc_fail_metric_id);
+			return boost::shared_ptr<BALANCE_OBJECT>();
+		}
+
+		// 부하 상한은 가중치 1 기준 인원이며 서버별로 가중치를 곱해서 비교한다.
+		float average_user_count = static_cast<float>(m_total_reported_user_count + 1) / std::max(m_total_capacity_weight, m_min_capacity_weight);
+		float load_bound = std::max(static_cast<float>(m_base_fill_user_count), std::ceil(average_user_count * m_affinity_load_factor));
+
+		uint64_t key_hash = hashKey(affinity_key);
+		auto it = std::lower_bound(m_hash_ring.begin(), m_hash_ring.end(), key_hash,
+								   [](const hash_node_t &node, uint64_t hash) -> bool
+								   {
+									   return node.m_hash < hash;
+								   });
+
+		// 시계방향으로 서버별 한번씩만 검사한다. 검사 표시는 호출마다 바뀌는 stamp로 하여 지우지 않는다.
+		if (0 == ++m_affinity_visit_stamp)
+		{
+			for (auto &server_entry_pair : m_server_entries)
+			{
+				server_entry_pair.second.m_affinity_visit_stamp = 0;
+			}
+			m_affinity_visit_stamp = 1;
+		}
+		size_t checked_count = 0;
+		for (size_t step = 0; step < m_hash_ring.size() && checked_count < m_server_entries.size(); ++step, ++it)
+		{
+			if (it == m_hash_ring.end())
+			{
+				it = m_hash_ring.begin();
+			}
+			server_entry_t &server_entry = *it->m_server_entry;
+			if (server_entry.m_affinity_visit_stamp == m_affinity_visit_stamp)
+			{
+				continue;
+			}
+			server_entry.m_affinity_visit_stamp = m_affinity_visit_stamp;
+			++checked_count;
+
+			const auto &balance_object = server_entry.m_balance_object;
+			refreshEntry(server_entry);
+			int32_t user_count = server_entry.m_reported_user_count;
+			if (balance_object->busyLevel() < BusyLevel_e::BUSY_WARN || user_count >= load_bound * server_entry.m_capacity_weight)
+			{
+				continue;
+			}
+
+			MetricsRegistry::instance().addCounter(m_affinity_alloc_metric_id);
+			if (checked_count > 1)
+			{
+				MetricsRegistry::instance().addCounter(m_affinity_spill_metric_id);
+			}
+			MetricsRegistry::instance().observe(m_alloc_fill_metric_id, user_count);
+			return balance_object;
+		}
+
+		ASYNC_LOG_TRACE("balancer.gameserver", "no idle gameserver for affinity_key:{0}", affinity_key);
+		MetricsRegistry::instance().addCounter(m_alloc_fail_metric_id);
+		return boost::shared_ptr<BALANCE_OBJECT>();
+	}
+
 	bool findObject(int32_t server_id, _out boost::shared_ptr<BALANCE_OBJECT> &balance_object)
 	{
 		auto it = std::find_if(m_balance_objects.begin(), m_balance_objects.end(),
@@ -194,25 +557,357 @@ public:
 		return true;
 	}
 
-	string_t toString()
+	string_t toString() const
 	{
 		string_t output;
-		for (auto balance_object : m_balance_objects)
+		toString(output);
+		return output;
+	}
+
+	// 객체별 toString() + " ", 결과 문자열을 재사용한다.
+	void toString(_out string_t &output) const
+	{
+		output.clear();
+		for (const auto &balance_object : m_balance_objects)
 		{
-			output += balance_object->toString() + " "; // +"\n";
+			output += balance_object->toString();
+			output += ' ';
 		}
-		return output;
 	}
 
-	std::vector<boost::shared_ptr<BALANCE_OBJECT>> balanceObjects()
+	// 서버별 "server_id:인원:혼잡도 ", 객체별 임시 문자열 없이 output에 바로 쓴다.
+	void toCompactString(_out string_t &output) const
+	{
+		output.clear();
+		char buffer[48];
+		for (const auto &balance_object : m_balance_objects)
+		{
+			int length = snprintf(buffer, sizeof(buffer), "%d:%d:%d ", balance_object->balanceKeyServerId(), balance_object->balanceKeyUserCount(), static_cast<int32_t>(balance_object->busyLevel()));
+			output.append(buffer, static_cast<size_t>(std::max(0, std::min<int>(length, sizeof(buffer) - 1))));
+		}
+	}
+
+	const std::vector<boost::shared_ptr<BALANCE_OBJECT>> &balanceObjects() const
 	{
 		return m_balance_objects;
 	}
 
+	// 복사 없이 순회, visitor(const BALANCE_OBJECT &)
+	template <typename VISITOR>
+	void forEachObject(VISITOR &&visitor) const
+	{
+		for (const auto &balance_object : m_balance_objects)
+		{
+			visitor(*balance_object);
+		}
+	}
+
+	// 모니터링용 상태 : status_header_t + status_record_t * 서버수
+	// buffer는 재사용하면 서버수가 늘지 않는 한 다시 할당하지 않는다.
+	void dumpStatus(_out std::vector<uint8_t> &buffer) const
+	{
+		buffer.resize(sizeof(status_header_t) + sizeof(status_record_t) * m_server_entries.size());
+
+		status_header_t header;
+		header.m_magic = STATUS_MAGIC;
+		header.m_version = STATUS_VERSION;
+		header.m_record_size = static_cast<uint16_t>(sizeof(status_record_t));
+		header.m_server_count = static_cast<uint32_t>(m_server_entries.size());
+		header.m_base_fill_user_count = m_base_fill_user_count;
+		std::fill(std::begin(header.m_level_counts), std::end(header.m_level_counts), 0);
+
+		uint8_t *output = buffer.data() + sizeof(status_header_t);
+		for (const auto &server_entry_pair : m_server_entries)
+		{
+			const server_entry_t &server_entry = server_entry_pair.second;
+			status_record_t record;
+			record.m_server_id = server_entry_pair.first;
+			record.m_user_count = server_entry.m_balance_object->balanceKeyUserCount();
+			record.m_pending_lease_count = server_entry.m_pending_lease_count;
+			record.m_confirmed_lease_count = server_entry.m_confirmed_lease_count;
+			record.m_capacity_weight = server_entry.m_capacity_weight;
+			record.m_busy_level = static_cast<uint8_t>(server_entry.m_balance_object->busyLevel());
+			memset(record.m_reserved, 0, sizeof(record.m_reserved));
+			memcpy(output, &record, sizeof(record));
+			output += sizeof(record);
+			++header.m_level_counts[record.m_busy_level];
+		}
+		memcpy(buffer.data(), &header, sizeof(header));
+	}
+
 public:
 	int32_t m_base_fill_user_count{200};
+	float m_max_fill_ratio{0.0f}; ///< 기준인원 대비 alloc 상한 배수(1 이상), 0이면 상한 없음
+	int32_t m_affinity_virtual_node_count{64}; ///< 서버별 ring 가상노드 수, 등록 전에 설정
+	float m_affinity_load_factor{1.25f};	   ///< 평균 대비 허용 부하 배수
+	float m_capacity_learn_rate{0.2f};		   ///< learnCapacityWeight 반영 비율
+	float m_min_capacity_weight{0.25f};
+	float m_max_capacity_weight{8.0f};
+	float m_lease_tick_sec{0.1f};	   ///< timer wheel 한칸, 만료 정밀도
+	float m_lease_reconcile_sec{5.0f}; ///< 확정 lease를 서버 보고 인원 반영 전까지 유지하는 최대 시간
+
+private:
+	struct server_entry_t;
+
+	// 혼잡도 내림, 가중치당 인원(effective / 가중치) 내림, server_id 오름
+	// 기준인원(m_base_fill_user_count)을 나누지 않으므로 기준인원을 바꿔도 순서가 유지된다.
+	struct index_key_t
+	{
+		int32_t m_busy_level{0};
+		double m_load{0.0};
+		int32_t m_server_id{0};
+		server_entry_t *m_server_entry{nullptr};
+
+		bool operator<(const index_key_t &right) const
+		{
+			if (m_busy_level != right.m_busy_level)
+			{
+				return m_busy_level > right.m_busy_level;
+			}
+			if (m_load != right.m_load)
+			{
+				return m_load > right.m_load;
+			}
+			return m_server_id < right.m_server_id;
+		}
+
+		bool operator!=(const index_key_t &right) const
+		{
+			return (m_busy_level != right.m_busy_level) || (m_load != right.m_load) || (m_server_id != right.m_server_id);
+		}
+	};
+
+	struct server_entry_t
+	{
+		boost::shared_ptr<BALANCE_OBJECT> m_balance_object;
+		float m_capacity_weight{1.0f};
+		int32_t m_reported_user_count{0};
+		int32_t m_pending_lease_count{0};
+		int32_t m_confirmed_lease_count{0}; ///< 확정되었지만 보고 인원에 아직 반영되지 않은 인원
+		uint32_t m_affinity_visit_stamp{0}; ///< allocByAffinity 검사 표시
+		index_key_t m_index_key;			///< m_server_index에 들어간 키
+	};
+
+	struct lease_info_t
+	{
+		int32_t m_server_id;
+		bool m_confirmed;
+		uint64_t m_expire_tick;
+	};
+
+	uint64_t scheduleLease(uint64_t lease_id, float timeout_sec)
+	{
+		uint64_t expire_tick = m_lease_tick + std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(timeout_sec / m_lease_tick_sec)));
+		m_lease_wheel[expire_tick % LEASE_WHEEL_SIZE].push_back(lease_id);
+		return expire_tick;
+	}
+
+	void releaseLease(const lease_info_t &lease_info)
+	{
+		if (!lease_info.m_confirmed)
+		{
+			--m_lease_pending_count;
+			MetricsRegistry::instance().setGauge(m_lease_pending_metric_id, static_cast<double>(m_lease_pending_count));
+		}
+
+		auto entry_it = m_server_entries.find(lease_info.m_server_id);
+		if (entry_it == m_server_entries.end())
+		{
+			return;
+		}
+		server_entry_t &server_entry = entry_it->second;
+		if (lease_info.m_confirmed)
+		{
+			// 보고 인원 증가로 이미 차감되었을 수 있다.
+			server_entry.m_confirmed_lease_count = std::max(0, server_entry.m_confirmed_lease_count - 1);
+		}
+		else
+		{
+			// 해제 후 같은 server_id로 재등록된 경우를 위해 음수가 되지 않게 한다.
+			server_entry.m_pending_lease_count = std::max(0, server_entry.m_pending_lease_count - 1);
+		}
+		refreshEntry(server_entry);
+	}
+
+	// 보고 인원을 다시 읽어 합계와 확정 lease에 반영한다.
+	int32_t syncReportedUserCount(server_entry_t &server_entry)
+	{
+		// 보고 인원이 늘어난 만큼 확정 lease가 반영된 것으로 본다.
+		int32_t reported_user_count = server_entry.m_balance_object->balanceKeyUserCount();
+		if (reported_user_count > server_entry.m_reported_user_count)
+		{
+			server_entry.m_confirmed_lease_count = std::max(0, server_entry.m_confirmed_lease_count - (reported_user_count - server_entry.m_reported_user_count));
+		}
+		m_total_reported_user_count += reported_user_count - server_entry.m_reported_user_count;
+		server_entry.m_reported_user_count = reported_user_count;
+		return reported_user_count;
+	}
+
+	void setEntryCapacityWeight(server_entry_t &server_entry, float capacity_weight)
+	{
+		m_total_capacity_weight += capacity_weight - server_entry.m_capacity_weight;
+		server_entry.m_capacity_weight = capacity_weight;
+	}
+
+	float clampCapacityWeight(float capacity_weight) const
+	{
+		return std::min(m_max_capacity_weight, std::max(m_min_capacity_weight, capacity_weight));
+	}
+
+	// 보고 인원 + lease 인원
+	static int32_t effectiveUserCount(const server_entry_t &server_entry)
+	{
+		return server_entry.m_balance_object->balanceKeyUserCount() + server_entry.m_pending_lease_count + server_entry.m_confirmed_lease_count;
+	}
+
+	double utilization(const server_entry_t &server_entry)
+	{
+		return static_cast<double>(effectiveUserCount(server_entry)) / (static_cast<double>(m_base_fill_user_count) * server_entry.m_capacity_weight);
+	}
+
+	double utilization(int32_t server_id)
+	{
+		auto it = m_server_entries.find(server_id);
+		if (it == m_server_entries.end())
+		{
+			return 0.0;
+		}
+		return utilization(it->second);
+	}
+
+	index_key_t makeIndexKey(server_entry_t &server_entry)
+	{
+		index_key_t index_key;
+		index_key.m_busy_level = static_cast<int32_t>(server_entry.m_balance_object->busyLevel());
+		index_key.m_load = static_cast<double>(effectiveUserCount(server_entry)) / server_entry.m_capacity_weight;
+		index_key.m_server_id = server_entry.m_balance_object->balanceKeyServerId();
+		index_key.m_server_entry = &server_entry;
+		return index_key;
+	}
+
+	// 보고 인원과 혼잡도를 다시 읽어 색인 키가 바뀌었으면 다시 넣는다. 바뀌었으면 true
+	bool refreshEntry(server_entry_t &server_entry)
+	{
+		syncReportedUserCount(server_entry);
+		index_key_t index_key = makeIndexKey(server_entry);
+		if (!(index_key != server_entry.m_index_key))
+		{
+			return false;
+		}
+		m_server_index.erase(server_entry.m_index_key);
+		--m_level_counts[server_entry.m_index_key.m_busy_level];
+		++m_level_counts[index_key.m_busy_level];
+		server_entry.m_index_key = index_key;
+		m_server_index.insert(index_key);
+		return true;
+	}
+
+	// 맨앞(가장 한가하고 가장 찬) 녀석이 기준 미만이면 그 녀석, 아니면 같은 혼잡도에서 가장 덜 찬 녀석
+	// 고른 녀석의 현재값이 색인과 다르면 다시 넣고 다시 고른다. m_server_entries가 비어있지 않아야 한다.
+	server_entry_t &pickCandidate()
+	{
+		server_entry_t *candidate_entry = nullptr;
+		for (size_t retry = 0; retry <= m_server_index.size(); ++retry)
+		{
+			const index_key_t &front_key = *m_server_index.begin();
+			candidate_entry = front_key.m_server_entry;
+			if (refreshEntry(*candidate_entry))
+			{
+				continue;
+			}
+			if (front_key.m_busy_level < BusyLevel_e::BUSY_WARN || front_key.m_load < static_cast<double>(m_base_fill_user_count))
+			{
+				return *candidate_entry;
+			}
+
+			// 같은 혼잡도의 마지막이 가장 덜 찬 녀석, 같은 인원이면 server_id가 작은 녀석
+			auto group_end_it = m_server_index.lower_bound(index_key_t{front_key.m_busy_level, -std::numeric_limits<double>::infinity(), std::numeric_limits<int32_t>::min(), nullptr});
+			double min_load = std::prev(group_end_it)->m_load;
+			auto candidate_it = m_server_index.lower_bound(index_key_t{front_key.m_busy_level, min_load, std::numeric_limits<int32_t>::min(), nullptr});
+			candidate_entry = candidate_it->m_server_entry;
+			if (!refreshEntry(*candidate_entry))
+			{
+				return *candidate_entry;
+			}
+		}
+		return *candidate_entry;
+	}
+
+private:
+	// unordered_map의 원소는 rehash 되어도 주소가 바뀌지 않으므로 entry를 직접 가리킨다.
+	struct hash_node_t
+	{
+		uint64_t m_hash;
+		server_entry_t *m_server_entry;
+	};
+
+	static uint64_t hashKey(uint64_t key)
+	{
+		// splitmix64
+		key += 0x9E3779B97F4A7C15ull;
+		key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+		key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+		return key ^ (key >> 31);
+	}
+
+	static uint64_t hashNode(int32_t server_id, int32_t replica)
+	{
+		return hashKey((static_cast<uint64_t>(static_cast<uint32_t>(server_id)) << 32) | static_cast<uint32_t>(replica));
+	}
+
+	void addHashRing(server_entry_t &server_entry)
+	{
+		int32_t server_id = server_entry.m_balance_object->balanceKeyServerId();
+		for (int32_t replica = 0; replica < m_affinity_virtual_node_count; ++replica)
+		{
+			m_hash_ring.push_back(hash_node_t{hashNode(server_id, replica), &server_entry});
+		}
+		std::sort(m_hash_ring.begin(), m_hash_ring.end(),
+				  [](const hash_node_t &left, const hash_node_t &right) -> bool
+				  {
+					  return left.m_hash < right.m_hash;
+				  });
+	}
+
+	void removeHashRing(int32_t server_id)
+	{
+		m_hash_ring.erase(std::remove_if(m_hash_ring.begin(), m_hash_ring.end(),
+										 [server_id](const hash_node_t &node) -> bool
+										 {
+											 return node.m_server_entry->m_balance_object->balanceKeyServerId() == server_id;
+										 }),
+						  m_hash_ring.end());
+	}
 
 private:
 	std::vector<boost::shared_ptr<BALANCE_OBJECT>> m_balance_objects;
 	boost::shared_ptr<BALANCE_OBJECT> m_dedicated_object;
+
+	metric_id_t m_alloc_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_alloc_fail_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_alloc_fill_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_server_count_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_affinity_alloc_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_affinity_spill_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_lease_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_lease_expired_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_overbook_avoided_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+	metric_id_t m_lease_pending_metric_id{MetricsRegistry::INVALID_METRIC_ID};
+
+	std::unordered_map<int32_t, server_entry_t> m_server_entries; ///< server_id -> 가중치, lease 인원
+	std::set<index_key_t> m_server_index;						   ///< alloc 후보 정렬 색인
+	int32_t m_level_counts[BusyLevel_e::_END] = {};				   ///< 색인에 반영된 혼잡도별 서버 수
+
+	std::unordered_map<uint64_t, lease_info_t> m_leases; ///< lease_id -> lease
+	std::vector<uint64_t> m_lease_wheel[LEASE_WHEEL_SIZE]; ///< 만료 tick % LEASE_WHEEL_SIZE 슬롯
+	uint64_t m_last_lease_id{0};
+	uint64_t m_lease_tick{0};
+	float m_lease_elapsed_sec{0.0f};
+	int32_t m_lease_pending_count{0};
+
+	std::vector<hash_node_t> m_hash_ring; ///< hash 오름차순
+	uint32_t m_affinity_visit_stamp{0};
+
+	int64_t m_total_reported_user_count{0}; ///< 서버별 m_reported_user_count 합계
+	float m_total_capacity_weight{0.0f};
 };
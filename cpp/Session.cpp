@@ -5,10 +5,87 @@
 
 #include "SessionManager.h"
 #include "Server.h"
+#include "BusyResourceSampler.h"
 #include <boost/enable_shared_from_this.hpp>
+#include <chrono>
+#include <limits>
+
+#if defined(__linux__)
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#endif
 
 using boost::asio::ip::tcp;
 
+namespace
+{
+	const int32_t ADMISSION_DRAIN_INTERVAL_MSEC = 100;
+
+	/// 입장 대기자가 있는 동안만 도는 drain 타이머, 처음 대기표를 받은 세션의 executor에서 돈다.
+	struct admission_drain_t
+	{
+		spin_mutex_t m_mutex;
+		bool m_scheduled{false};
+		std::chrono::steady_clock::time_point m_last_time_point;
+	};
+
+	admission_drain_t &admissionDrain()
+	{
+		static admission_drain_t s_admission_drain;
+		return s_admission_drain;
+	}
+
+	void waitAdmissionDrain(boost::shared_ptr<boost::asio::steady_timer> timer, SessionManager *session_manager)
+	{
+		timer->expires_after(std::chrono::milliseconds(ADMISSION_DRAIN_INTERVAL_MSEC));
+		timer->async_wait([timer, session_manager](const boost::system::error_code &error_code)
+						  {
+							  auto &admission_drain = admissionDrain();
+							  auto &admission_queue = AdmissionQueue::instance();
+							  if (error_code)
+							  {
+								  spin_mutex_t::scoped_lock lock(admission_drain.m_mutex);
+								  admission_drain.m_scheduled = false;
+								  return;
+							  }
+
+							  auto now = std::chrono::steady_clock::now();
+							  float elapsed_sec = std::chrono::duration<float>(now - admission_drain.m_last_time_point).count();
+							  admission_drain.m_last_time_point = now;
+
+							  // 게임서버 여유 인원은 로그인 처리의 alloc에서 다시 확인한다.
+							  std::vector<uint64_t> session_ids;
+							  const CompositeBusyLevel *busy_level = admission_queue.busyLevelSource();
+							  if (busy_level)
+							  {
+								  admission_queue.drain(*busy_level, std::numeric_limits<int32_t>::max(), elapsed_sec, session_ids);
+							  }
+							  else
+							  {
+								  admission_queue.drain(BusyLevel_e::BUSY_IDLE, 0.0f, std::numeric_limits<int32_t>::max(), elapsed_sec, session_ids);
+							  }
+							  for (auto session_id : session_ids)
+							  {
+								  auto session = boost::static_pointer_cast<Session>(session_manager->getSessionById(session_id));
+								  if (session)
+								  {
+									  session->admitFromQueue();
+								  }
+							  }
+
+							  {
+								  spin_mutex_t::scoped_lock lock(admission_drain.m_mutex);
+								  if (0 == admission_queue.waitingCount())
+								  {
+									  admission_drain.m_scheduled = false;
+									  return;
+								  }
+							  }
+							  waitAdmissionDrain(timer, session_manager);
+						  });
+	}
+} // namespace
+
 #if BOOST_VERSION >= 107000
 static gplat::asio::io_context null_io_context;
 
@@ -26,7 +103,8 @@ Session::Session(void)
 
 Session::~Session(void)
 {
-	LOG_DEBUG("Session close session id : {0}", sessionId());
+	ASYNC_LOG_DEBUG("network.session", "Session close session id : {0}", sessionId());
+	m_routing_table.freeSlot(m_routing_slot.exchange(SessionRoutingTable::INVALID_SLOT), sessionId());
 }
 
 void Session::setSocket(SocketBase *socket)
@@ -36,9 +114,22 @@ void Session::setSocket(SocketBase *socket)
 
 void Session::onClose()
 {
-	LOG_DEBUG("closed sessionId:{0}", *m_session_instant_id);
+	ASYNC_LOG_DEBUG("network.session", "closed sessionId:{0}", sessionId());
 	setSessionState(session_state_e::session_closed);
 
+	AdmissionQueue::instance().cancel(m_admission_ticket.exchange(AdmissionQueue::INVALID_TICKET));
+	m_routing_table.freeSlot(m_routing_slot.exchange(SessionRoutingTable::INVALID_SLOT), sessionId());
+	if (m_busy_poll_attached.exchange(false))
+	{
+		BusyPollRunner::instance().detach();
+	}
+
+	// 대기중인 송신 함수가 패킷/사용자를 잡고 있지 않도록 비운다.
+	m_outbound_quota.clear();
+
+	MetricsRegistry::instance().addCounter(metricIds().m_close_id);
+	MetricsRegistry::instance().addGauge(metricIds().m_session_count_id, -1.0);
+
 	msg_gen_network::notify_socket_closed notify;
 	notify.session_id = sessionId();
 	notify.closeReason;
@@ -70,6 +161,7 @@ gplat::Result Session::init(SessionManager *session_manager)
 	}
 	if (m_base_socket->asioSocket())
 	{
+		// 세션이 공유되기 전에 만들어 두어 clientAddress()는 읽기만 한다.
 		boost::system::error_code boost_error_code;
 		tcp::endpoint client_end_point = m_base_socket->asioSocket()->remote_endpoint(boost_error_code);
 
@@ -81,17 +173,353 @@ gplat::Result Session::init(SessionManager *session_manager)
 				m_client_address = ip_address;
 			}
 		}
+
 		setSessionState(session_state_e::session_established);
 		gplat::Result res = m_base_socket->setSocketOptions();
 		if (res.fail())
 		{
 			return res;
 		}
+		applySocketProfile();
+
+		// 채널 자원 샘플 타이머는 처음 세션의 io_context에서 한번만 시작된다.
+		BusyResourceSampler::instance().start(static_cast<gplat::asio::io_context &>(m_base_socket->asioSocket()->get_executor().context()));
 	}
 	m_session_manager = session_manager;
+
+	m_routing_slot.store(m_routing_table.allocSlot(sessionId()), std::memory_order_release);
+	if (!m_routing_table.isValidSlot(routingSlot()))
+	{
+		LOG_WARN("routing table full. capacity:{0}", m_routing_table.capacity());
+	}
+	syncRouting();
+
+	MetricsRegistry::instance().addCounter(metricIds().m_open_id);
+	MetricsRegistry::instance().addGauge(metricIds().m_session_count_id, 1.0);
+
 	return afterInitSession();
 }
 
+const Session::metric_ids_t &Session::metricIds()
+{
+	static const metric_ids_t s_metric_ids = []()
+	{
+		auto &registry = MetricsRegistry::instance();
+		metric_ids_t metric_ids;
+		metric_ids.m_open_id = registry.registerCounter("session_open_total");
+		metric_ids.m_close_id = registry.registerCounter("session_close_total");
+		metric_ids.m_relay_packet_id = registry.registerCounter("session_relay_packet_total");
+		metric_ids.m_session_count_id = registry.registerGauge("session_count");
+		return metric_ids;
+	}();
+	return s_metric_ids;
+}
+
+void Session::syncRouting()
+{
+	uint32_t routing_slot = routingSlot();
+	if (!m_routing_table.isValidSlot(routing_slot))
+	{
+		return;
+	}
+
+	SessionRoutingTable::route_t route;
+	makeRoute(route);
+	m_routing_table.update(routing_slot, sessionId(), route); // 이미 반환된 slot이면 무시된다.
+}
+
+void Session::makeRoute(_out SessionRoutingTable::route_t &out_route) const
+{
+	out_route.m_session_id = sessionId();
+	out_route.m_channel_server_id = m_channel_server_id;
+	out_route.m_logic_server_id = m_logic_server_id;
+	out_route.m_zone_server_id = m_zone_server_id;
+	out_route.m_session_type = static_cast<uint8_t>(m_session_type);
+	out_route.m_session_state = static_cast<uint8_t>(m_session_state);
+	out_route.m_account_db_id = m_account_db_id;
+	out_route.m_guild_db_id = m_guild_db_id;
+	out_route.m_community_id = m_community_id;
+}
+
+void Session::restoreRouting()
+{
+	SessionRoutingSnapshot::resume_t resume;
+	if (0 == m_account_db_id || !SessionRoutingSnapshot::instance().takeResume(m_account_db_id, resume))
+	{
+		return;
+	}
+
+	if (0 == m_logic_server_id)
+	{
+		m_logic_server_id = resume.m_logic_server_id;
+	}
+	if (0 == m_zone_server_id)
+	{
+		m_zone_server_id = resume.m_zone_server_id;
+	}
+	if (0 == m_guild_db_id)
+	{
+		m_guild_db_id = resume.m_guild_db_id;
+	}
+	if (0 == m_community_id)
+	{
+		m_community_id = resume.m_community_id;
+	}
+	LOG_INFO("routing restored from snapshot. logic_server_id:{0} zone_server_id:{1}", m_logic_server_id, m_zone_server_id);
+}
+
+void Session::applySocketProfile()
+{
+	if (!m_base_socket || !m_base_socket->asioSocket())
+	{
+		return;
+	}
+
+	// 기본 옵션(setSocketOptions) 위에 세션 종류별 옵션을 덮어쓴다. 실패해도 접속은 유지
+	socket_profile_t profile = SocketProfileRegistry::instance().profile(static_cast<int32_t>(m_session_type));
+	auto sock = m_base_socket->asioSocket();
+	gplat::Result res = SocketProfileRegistry::apply(*sock, profile);
+	if (res.fail())
+	{
+		LOG_WARN("apply socket profile failed. session_type:{0} {1}", m_session_type, res.toString());
+	}
+	m_cork.store(profile.m_cork, std::memory_order_relaxed);
+
+	// 공유 io_context는 busy poll 하지 않는다. run-to-completion 세션은 BusyPollRunner의 io_context에서 만들어져야 붙는다.
+	auto &busy_poll_runner = BusyPollRunner::instance();
+	if (profile.m_run_to_completion)
+	{
+		if (!m_busy_poll_attached.exchange(true) && !busy_poll_runner.attach(static_cast<gplat::asio::io_context &>(sock->get_executor().context())))
+		{
+			m_busy_poll_attached.store(false);
+			LOG_WARN("run to completion session is not on busy poll io_context. session_type:{0}", m_session_type);
+		}
+	}
+	else if (m_busy_poll_attached.exchange(false))
+	{
+		busy_poll_runner.detach();
+	}
+}
+
+boost::asio::ip::tcp::socket *Session::corkSocket() const
+{
+	if (!m_base_socket)
+	{
+		return nullptr;
+	}
+	return m_base_socket->asioSocket().get();
+}
+
+uint32_t Session::queuedSendBytes() const
+{
+#if defined(__linux__)
+	if (!m_base_socket || !m_base_socket->asioSocket())
+	{
+		return 0;
+	}
+
+	int queued_bytes = 0;
+	if (0 != ioctl(m_base_socket->asioSocket()->native_handle(), SIOCOUTQ, &queued_bytes) || queued_bytes < 0)
+	{
+		return 0;
+	}
+	return static_cast<uint32_t>(queued_bytes);
+#else
+	return 0;
+#endif
+}
+
+thread_local Session::send_scope_t *Session::s_send_scope = nullptr;
+
+bool Session::sendPacket(boost::shared_ptr<Packet> in_packet, bool in_sync_send)
+{
+	if (in_sync_send || !in_packet)
+	{
+		return Socket::sendPacket(in_packet, in_sync_send);
+	}
+
+	send_scope_t *send_scope = (s_send_scope && this == s_send_scope->m_session) ? s_send_scope : nullptr;
+	send_priority_e::TYPE priority = send_scope ? send_scope->m_priority : send_priority_e::normal;
+	uint64_t coalesce_key = send_scope ? send_scope->m_coalesce_key : 0;
+
+	// 대기열의 송신 함수는 admit 안이나 세션을 잡은 flush 타이머에서만 불리므로 this로 충분하다.
+	outbound_result_e::TYPE result = m_outbound_quota.admit(in_packet->packetSize(), priority, coalesce_key,
+															[this, in_packet]()
+															{
+																Socket::sendPacket(in_packet, false);
+															});
+	if (send_scope)
+	{
+		send_scope->m_result = result;
+	}
+
+	switch (result)
+	{
+	case outbound_result_e::sent:
+		return true;
+	case outbound_result_e::queued:
+	case outbound_result_e::coalesced:
+		scheduleOutboundFlush();
+		return true;
+	case outbound_result_e::dropped:
+		return false;
+	case outbound_result_e::disconnect:
+		LOG_WARN("outbound over budget. pending_bytes:{0} pending_packets:{1}", m_outbound_quota.pendingBytes(), m_outbound_quota.pendingPackets());
+		m_outbound_quota.clear();
+		postClose();
+		return false;
+	}
+	return false;
+}
+
+void Session::scheduleOutboundFlush()
+{
+	auto sock = corkSocket();
+	if (!sock || !m_outbound_quota.scheduleFlush())
+	{
+		return;
+	}
+	waitOutboundFlush(boost::make_shared<boost::asio::steady_timer>(sock->get_executor()));
+}
+
+void Session::waitOutboundFlush(boost::shared_ptr<boost::asio::steady_timer> timer)
+{
+	boost::weak_ptr<Session> weak_session = shared_from_this();
+	timer->expires_after(std::chrono::milliseconds(m_outbound_quota.flushIntervalMsec()));
+	timer->async_wait([timer, weak_session](const boost::system::error_code &error_code)
+					  {
+						  auto session = weak_session.lock();
+						  if (!session)
+						  {
+							  return;
+						  }
+						  if (error_code)
+						  {
+							  session->m_outbound_quota.clear();
+							  session->m_outbound_quota.endFlush();
+							  return;
+						  }
+						  session->flushOutbound(timer);
+					  });
+}
+
+void Session::flushOutbound(boost::shared_ptr<boost::asio::steady_timer> timer)
+{
+	// 커널 큐는 타이머 한번에 한번만 잰다.
+	std::vector<OutboundQuota::send_func_t> send_funcs;
+	if (outbound_result_e::disconnect == m_outbound_quota.flush(queuedSendBytes(), send_funcs))
+	{
+		LOG_WARN("outbound stalled. pending_bytes:{0} pending_packets:{1}", m_outbound_quota.pendingBytes(), m_outbound_quota.pendingPackets());
+		m_outbound_quota.clear();
+		m_outbound_quota.endFlush();
+		postClose();
+		return;
+	}
+
+	// 꺼낸 묶음의 쓰기를 TCP_CORK로 묶는다. 이미 executor에 쌓인 쓰기 완료가 처리된 후 풀리도록 post로 푼다.
+	auto sock = corkSocket();
+	boost::shared_ptr<cork_scope_t> cork_scope;
+	if (sock && 1 < send_funcs.size() && m_cork.load(std::memory_order_relaxed))
+	{
+		cork_scope = boost::make_shared<cork_scope_t>(sock);
+	}
+	for (auto &send_func : send_funcs)
+	{
+		send_func();
+	}
+	if (cork_scope)
+	{
+		boost::asio::post(sock->get_executor(), [cork_scope]() mutable { cork_scope.reset(); });
+	}
+
+	if (m_outbound_quota.endFlush())
+	{
+		waitOutboundFlush(timer);
+	}
+}
+
+void Session::requestAdmission()
+{
+	if (session_type_e::user != m_session_type)
+	{
+		return;
+	}
+
+	auto &admission_queue = AdmissionQueue::instance();
+	const CompositeBusyLevel *busy_level = admission_queue.busyLevelSource();
+	uint64_t ticket = AdmissionQueue::INVALID_TICKET;
+	switch (admission_queue.request(sessionId(), busy_level ? busy_level->currentBusyLevel() : BusyLevel_e::BUSY_IDLE, ticket))
+	{
+	case admission_result_e::admitted:
+	{
+		gplat::Result res = afterAdmitted();
+		if (res.fail())
+		{
+			LOG_ERROR(res.toString());
+		}
+		break;
+	}
+	case admission_result_e::queued:
+	{
+		m_admission_ticket.store(ticket);
+		LOG_INFO("admission queued. ticket:{0} position:{1}", ticket, admission_queue.position(ticket));
+
+		auto sock = corkSocket();
+		auto &admission_drain = admissionDrain();
+		spin_mutex_t::scoped_lock lock(admission_drain.m_mutex);
+		if (sock && m_session_manager && !admission_drain.m_scheduled)
+		{
+			admission_drain.m_scheduled = true;
+			admission_drain.m_last_time_point = std::chrono::steady_clock::now();
+			waitAdmissionDrain(boost::make_shared<boost::asio::steady_timer>(sock->get_executor()), m_session_manager);
+		}
+		break;
+	}
+	case admission_result_e::rejected:
+		LOG_WARN("admission rejected. waiting_count:{0}", admission_queue.waitingCount());
+		postClose();
+		break;
+	}
+}
+
+void Session::admitFromQueue()
+{
+	m_admission_ticket.store(AdmissionQueue::INVALID_TICKET);
+	auto sock = corkSocket();
+	if (!sock)
+	{
+		return;
+	}
+
+	auto self = shared_from_this();
+	boost::asio::post(sock->get_executor(),
+					  [this, self]()
+					  {
+						  gplat::Result res = afterAdmitted();
+						  if (res.fail())
+						  {
+							  LOG_ERROR(res.toString());
+						  }
+					  });
+}
+
+void Session::postClose()
+{
+	if (!m_base_socket || !m_base_socket->asioSocket())
+	{
+		return;
+	}
+
+	// 송신 스레드와 다른 스레드에서 호출될 수 있으므로 소켓 executor에서 닫는다. 이후 onClose 흐름을 탄다.
+	auto sock = m_base_socket->asioSocket();
+	boost::asio::post(sock->get_executor(),
+					  [sock]()
+					  {
+						  boost::system::error_code boost_error_code;
+						  sock->close(boost_error_code);
+					  });
+}
+
 gplat::Result Session::afterInitSession()
 {
 	return gplat::Result().setOk();
@@ -3,6 +3,14 @@
 
 #include <libGen/cpp/network/Socket.h>
 #include <libGen/cpp/base/InstantId.h>
+#include "SessionRoutingTable.h"
+#include "SessionRoutingSnapshot.h"
+#include "MetricsRegistry.h"
+#include "AsyncLogSink.h"
+#include "OutboundQuota.h"
+#include "SocketProfile.h"
+#include "AdmissionQueue.h"
+#include <boost/asio/steady_timer.hpp>
 struct session_state_e
 {
 	enum type
@@ -26,8 +34,9 @@ public:
 	{
 		setSocket(this);
 		m_session_instant_id = session_instant_id;
-		setDefaultLoggerNdc(sformat("/new sessionId:{0}/", sessionId()));
-		LOG_INFO("new session:{}", *m_session_instant_id);
+		m_async_logger_id = AsyncLogSink::instance().registerLogger(logger_name);
+		setLoggerNdc(sformat("/new sessionId:{0}/", sessionId()));
+		ASYNC_LOG_INFO("network.session", "new session:{}", sessionId());
 	}
 
 	Session(void);
@@ -59,17 +68,24 @@ public:
 		//버퍼에서 가지와서 변경 후
 		// in_packet->bufferToHeader();
 
-		in_packet->packetHeader().setSessionId(*m_session_instant_id); // sessionId
-		in_packet->packetHeader().setServerId(m_channel_server_id);	   // current server id
+		// 릴레이 경로는 라우팅 테이블 slot을 읽는다. slot이 없거나(테이블 가득 참) 이미 반환되었으면 세션 멤버를 쓴다.
+		SessionRoutingTable::route_t route;
+		if (!m_routing_table.ownedRoute(routingSlot(), sessionId(), route))
+		{
+			makeRoute(route);
+		}
+		in_packet->packetHeader().setSessionId(route.m_session_id);			// sessionId
+		in_packet->packetHeader().setServerId(route.m_channel_server_id); // current server id
 
 		// user session인 경우에만 넣어준다.
-		if (session_type_e::user == m_session_type)
+		if (static_cast<uint8_t>(session_type_e::user) == route.m_session_type)
 		{
-			in_packet->packetHeader().setAuthDbId(m_account_db_id); //
-																	// in_packet->packetHeader().copySessionGuid();
+			in_packet->packetHeader().setAuthDbId(route.m_account_db_id); //
+																		  // in_packet->packetHeader().copySessionGuid();
 		}
 
 		in_packet->headerToBuffer(); // 버퍼에 반영 릴레이 정보
+		MetricsRegistry::instance().addCounter(metricIds().m_relay_packet_id);
 	}
 
 	session_state_e::type sessionState() const
@@ -80,6 +96,7 @@ public:
 	void setSessionState(session_state_e::type in_session_state)
 	{
 		m_session_state = in_session_state;
+		syncRouting();
 	}
 
 	bool isSessionState(session_state_e::type in_session_state) const
@@ -90,7 +107,9 @@ public:
 public:
 	void setCertified()
 	{
+		restoreRouting();
 		setSessionState(session_state_e::session_certified);
+		requestAdmission();
 	}
 	bool isCertified() const
 	{
@@ -101,7 +120,9 @@ public:
 	void setSessionType(session_type_e::type session_type)
 	{
 		m_session_type = session_type;
-		setDefaultLoggerNdc(sformat("/sessionId:{0}, session_type:{1}, account_db_id:{2}/", sessionId(), m_session_type, m_account_db_id));
+		setLoggerNdc(sformat("/sessionId:{0}, session_type:{1}, account_db_id:{2}/", sessionId(), m_session_type, m_account_db_id));
+		syncRouting();
+		applySocketProfile();
 	}
 
 	bool isSessionType(session_type_e::type session_type)
@@ -122,14 +143,100 @@ public:
 	void changeZoneServerId(const uint16_t zone_server_id)
 	{
 		m_zone_server_id = zone_server_id;
+		syncRouting();
 	}
 
+	/// 라우팅 필드를 변경한 후 호출하여 라우팅 테이블에 반영한다.
+	void syncRouting();
+
+	/// 재시작 전 스냅샷에 같은 계정의 라우팅 정보가 있으면 비어있는 필드에 채운다. 인증시 한번 호출
+	void restoreRouting();
+
+	/// 현재 세션 종류의 소켓 profile 적용, init과 setSessionType에서 호출
+	void applySocketProfile();
+
+	/// 사용자 세션 입장 요청, 바로 입장이면 afterAdmitted, 아니면 대기표를 받아 drain 타이머에서 입장한다.
+	void requestAdmission();
+
+	/// 대기열에서 입장 허용됨, 세션 executor에서 afterAdmitted를 호출한다.
+	void admitFromQueue();
+
+	/// 라우팅 필드를 세션 멤버에서 채운다. syncRouting과 slot이 없는 경우의 릴레이에서 사용
+	void makeRoute(_out SessionRoutingTable::route_t &out_route) const;
+
+	uint32_t routingSlot() const
+	{
+		return m_routing_slot.load(std::memory_order_acquire);
+	}
+
+public:
+	/// 세션 송신 진입점, 릴레이와 알림(send, sendToUser 등)이 모두 여기로 온다.
+	/// 동기 송신이 아니면 송신 예산(m_outbound_quota)을 거쳐 소켓에 넘기거나 세션 대기열에 넣는다.
+	bool sendPacket(boost::shared_ptr<Packet> in_packet, bool in_sync_send = false) override;
+
+	/// send_func(실제 송신) 안에서 이 세션으로 보내는 패킷을 priority/coalesce_key로 예산에 넣는다.
+	/// 대기열이 밀려 있으면 low 우선순위는 coalesce_key별 최신값만 남기거나 버리고, 예산을 넘거나 정체가 계속되면 접속을 끊는다.
+	template <typename SEND_FUNC>
+	outbound_result_e::TYPE sendWithQuota(send_priority_e::TYPE priority, uint64_t coalesce_key, SEND_FUNC send_func)
+	{
+		send_scope_t send_scope(this, priority, coalesce_key);
+		send_func();
+		return send_scope.m_result;
+	}
+
+	/// 소켓 송신 큐에 남아있는(상대가 아직 ack하지 않은) 바이트, 지원하지 않는 플랫폼은 0
+	/// flush 타이머에서 한번씩만 잰다.
+	uint32_t queuedSendBytes() const;
+
+	OutboundQuota &outboundQuota()
+	{
+		return m_outbound_quota;
+	}
+
+protected:
+	/// sendWithQuota 범위의 우선순위, 같은 스레드에서 같은 세션의 sendPacket이 읽는다.
+	struct send_scope_t
+	{
+		send_scope_t(const Session *session, send_priority_e::TYPE priority, uint64_t coalesce_key)
+			: m_session(session), m_priority(priority), m_coalesce_key(coalesce_key), m_prev(s_send_scope)
+		{
+			s_send_scope = this;
+		}
+		~send_scope_t()
+		{
+			s_send_scope = m_prev;
+		}
+
+		const Session *m_session;
+		send_priority_e::TYPE m_priority;
+		uint64_t m_coalesce_key;
+		outbound_result_e::TYPE m_result{outbound_result_e::sent};
+		send_scope_t *m_prev;
+	};
+	static thread_local send_scope_t *s_send_scope;
+
+	/// 세션 대기열이 빌 때까지 도는 flush 타이머, 소켓 executor에서 돈다.
+	void scheduleOutboundFlush();
+	void waitOutboundFlush(boost::shared_ptr<boost::asio::steady_timer> timer);
+	void flushOutbound(boost::shared_ptr<boost::asio::steady_timer> timer);
+
+protected:
+	/// 다른 스레드에서도 호출할 수 있도록 소켓 executor에서 닫는다.
+	void postClose();
+
+	boost::asio::ip::tcp::socket *corkSocket() const;
+
 protected:
 	virtual gplat::Result afterInitSession();
 	virtual gplat::Result afterSessionInfoChanged()
 	{
 		return gplat::Result().setOk();
 	}
+	/// 사용자 세션 입장 허용 후 로그인 처리를 이어간다.
+	virtual gplat::Result afterAdmitted()
+	{
+		return gplat::Result().setOk();
+	}
 
 public:
 	uint64_t sessionId() const
@@ -137,6 +244,33 @@ public:
 		return *m_session_instant_id;
 	}
 
+	/// ASYNC_LOG_* 매크로가 사용, 동기 로그와 같은 로거/NDC로 기록되게 한다.
+	async_log_context_t asyncLogContext() const
+	{
+		async_log_context_t context;
+		context.m_logger_id = m_async_logger_id;
+		context.m_ndc = boost::atomic_load(&m_async_log_ndc);
+		return context;
+	}
+
+protected:
+	/// 동기 로그 NDC와 비동기 로그 NDC를 같이 바꾼다.
+	void setLoggerNdc(const string_t &ndc)
+	{
+		setDefaultLoggerNdc(ndc);
+		boost::atomic_store(&m_async_log_ndc, boost::make_shared<const string_t>(ndc));
+	}
+
+public:
+	struct metric_ids_t
+	{
+		metric_id_t m_open_id;
+		metric_id_t m_close_id;
+		metric_id_t m_relay_packet_id;
+		metric_id_t m_session_count_id;
+	};
+	static const metric_ids_t &metricIds();
+
 public:
 	uint16_t m_session_group{0};
 
@@ -165,4 +299,15 @@ public:
 
 protected:
 	SessionManager *m_session_manager{nullptr};
+
+	SessionRoutingTable &m_routing_table{SessionRoutingTable::instance()};
+	std::atomic<uint32_t> m_routing_slot{SessionRoutingTable::INVALID_SLOT}; ///< onClose와 다른 스레드의 syncRouting이 겹칠 수 있다.
+
+	OutboundQuota m_outbound_quota;
+	std::atomic<bool> m_cork{false};				///< 현재 socket profile, flush 타이머에서 읽는다.
+	std::atomic<bool> m_busy_poll_attached{false}; ///< BusyPollRunner에 붙어 있으면 onClose에서 detach
+	std::atomic<uint64_t> m_admission_ticket{AdmissionQueue::INVALID_TICKET}; ///< 입장 대기중인 대기표, onClose에서 취소
+
+	uint32_t m_async_logger_id{0};
+	boost::shared_ptr<const string_t> m_async_log_ndc; ///< 다른 스레드의 로그와 겹칠 수 있어 atomic_load/store로 접근
 };
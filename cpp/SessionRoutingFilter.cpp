@@ -0,0 +1,194 @@
+//
+
+#include "preheader.h"
+
+#include "SessionRoutingFilter.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	const uint32_t BLOCK_SLOT_COUNT = 32;
+
+#if defined(__AVX2__)
+	// 컬럼은 값과 같은 크기의 atomic 배열이다. block version으로 검증하므로 32개를 한번에 읽는다.
+	template <typename T>
+	inline const __m256i *simdPointer(const std::atomic<T> *column)
+	{
+		return reinterpret_cast<const __m256i *>(column);
+	}
+
+	inline uint32_t matchMask8(const std::atomic<uint8_t> *column, uint8_t value)
+	{
+		__m256i data = _mm256_loadu_si256(simdPointer(column));
+		__m256i eq = _mm256_cmpeq_epi8(data, _mm256_set1_epi8(static_cast<char>(value)));
+		return static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+	}
+
+	inline uint32_t matchMask16(const std::atomic<uint16_t> *column, uint16_t value)
+	{
+		__m256i key = _mm256_set1_epi16(static_cast<short>(value));
+		__m256i eq0 = _mm256_cmpeq_epi16(_mm256_loadu_si256(simdPointer(column)), key);
+		__m256i eq1 = _mm256_cmpeq_epi16(_mm256_loadu_si256(simdPointer(column + 16)), key);
+
+		// packs는 128bit lane 단위로 섞이므로 64bit 단위 순서를 바로잡는다.
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(eq0, eq1), 0xD8);
+		return static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+	}
+
+	inline uint32_t matchMask32(const std::atomic<int32_t> *column, int32_t value)
+	{
+		__m256i key = _mm256_set1_epi32(value);
+		__m256i eq0 = _mm256_cmpeq_epi32(_mm256_loadu_si256(simdPointer(column)), key);
+		__m256i eq1 = _mm256_cmpeq_epi32(_mm256_loadu_si256(simdPointer(column + 8)), key);
+		__m256i eq2 = _mm256_cmpeq_epi32(_mm256_loadu_si256(simdPointer(column + 16)), key);
+		__m256i eq3 = _mm256_cmpeq_epi32(_mm256_loadu_si256(simdPointer(column + 24)), key);
+
+		__m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(eq0, eq1), _mm256_packs_epi32(eq2, eq3));
+		packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+		return static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+	}
+#endif
+
+	template <typename T>
+	inline uint32_t matchMaskScalar(const std::atomic<T> *column, T value)
+	{
+		uint32_t mask = 0;
+		for (uint32_t index = 0; index < BLOCK_SLOT_COUNT; ++index)
+		{
+			mask |= static_cast<uint32_t>(column[index].load(std::memory_order_relaxed) == value) << index;
+		}
+		return mask;
+	}
+} // namespace
+
+uint32_t SessionSlotBitmap::count() const
+{
+	uint32_t total = 0;
+	for (auto word : m_words)
+	{
+		total += popCount64(word);
+	}
+	return total;
+}
+
+void SessionRoutingFilter::scan(const SessionRoutingTable &routing_table, _out SessionSlotBitmap &out_bitmap) const
+{
+	out_bitmap.reset(routing_table.capacity());
+	auto &words = out_bitmap.words();
+
+	// capacity는 64의 배수이므로 두 block이 하나의 word(테이블 block 하나)가 된다.
+	// 읽는 도중 테이블 block이 갱신되었으면 그 block만 다시 읽는다.
+	for (uint32_t begin_slot = 0; begin_slot < routing_table.capacity(); begin_slot += BLOCK_SLOT_COUNT * 2)
+	{
+		uint32_t block_index = begin_slot / SessionRoutingTable::BLOCK_SLOT_COUNT;
+		uint64_t word = 0;
+		uint32_t version = 0;
+		do
+		{
+			version = routing_table.readBlockBegin(block_index);
+			uint64_t low = matchBlock(routing_table, begin_slot);
+			uint64_t high = matchBlock(routing_table, begin_slot + BLOCK_SLOT_COUNT);
+			word = low | (high << 32);
+		} while (routing_table.readBlockRetry(block_index, version));
+		words[begin_slot >> 6] = word;
+	}
+}
+
+void SessionRoutingFilter::scanScalar(const SessionRoutingTable &routing_table, _out SessionSlotBitmap &out_bitmap) const
+{
+	out_bitmap.reset(routing_table.capacity());
+	auto &words = out_bitmap.words();
+
+	for (uint32_t begin_slot = 0; begin_slot < routing_table.capacity(); begin_slot += BLOCK_SLOT_COUNT * 2)
+	{
+		uint32_t block_index = begin_slot / SessionRoutingTable::BLOCK_SLOT_COUNT;
+		uint64_t word = 0;
+		uint32_t version = 0;
+		do
+		{
+			version = routing_table.readBlockBegin(block_index);
+			uint64_t low = matchBlockScalar(routing_table, begin_slot);
+			uint64_t high = matchBlockScalar(routing_table, begin_slot + BLOCK_SLOT_COUNT);
+			word = low | (high << 32);
+		} while (routing_table.readBlockRetry(block_index, version));
+		words[begin_slot >> 6] = word;
+	}
+}
+
+uint32_t SessionRoutingFilter::matchBlock(const SessionRoutingTable &routing_table, uint32_t begin_slot) const
+{
+#if defined(__AVX2__)
+	// 빈 slot은 제외
+	uint32_t mask = matchMask8(routing_table.occupiedColumn() + begin_slot, 1);
+	if (0 == mask)
+	{
+		return 0;
+	}
+
+	if (m_use_session_state)
+	{
+		mask &= matchMask8(routing_table.sessionStateColumn() + begin_slot, m_session_state);
+	}
+	if (m_use_session_type && 0 != mask)
+	{
+		mask &= matchMask8(routing_table.sessionTypeColumn() + begin_slot, m_session_type);
+	}
+	if (m_use_logic_server_id && 0 != mask)
+	{
+		mask &= matchMask16(routing_table.logicServerIdColumn() + begin_slot, m_logic_server_id);
+	}
+	if (m_use_zone_server_id && 0 != mask)
+	{
+		mask &= matchMask16(routing_table.zoneServerIdColumn() + begin_slot, m_zone_server_id);
+	}
+	if (m_use_guild_db_id && 0 != mask)
+	{
+		mask &= matchMask32(routing_table.guildDbIdColumn() + begin_slot, m_guild_db_id);
+	}
+	if (m_use_community_id && 0 != mask)
+	{
+		mask &= matchMask32(routing_table.communityIdColumn() + begin_slot, m_community_id);
+	}
+	return mask;
+#else
+	return matchBlockScalar(routing_table, begin_slot);
+#endif
+}
+
+uint32_t SessionRoutingFilter::matchBlockScalar(const SessionRoutingTable &routing_table, uint32_t begin_slot) const
+{
+	uint32_t mask = matchMaskScalar<uint8_t>(routing_table.occupiedColumn() + begin_slot, 1);
+	if (0 == mask)
+	{
+		return 0;
+	}
+
+	if (m_use_session_state)
+	{
+		mask &= matchMaskScalar(routing_table.sessionStateColumn() + begin_slot, m_session_state);
+	}
+	if (m_use_session_type)
+	{
+		mask &= matchMaskScalar(routing_table.sessionTypeColumn() + begin_slot, m_session_type);
+	}
+	if (m_use_logic_server_id)
+	{
+		mask &= matchMaskScalar(routing_table.logicServerIdColumn() + begin_slot, m_logic_server_id);
+	}
+	if (m_use_zone_server_id)
+	{
+		mask &= matchMaskScalar(routing_table.zoneServerIdColumn() + begin_slot, m_zone_server_id);
+	}
+	if (m_use_guild_db_id)
+	{
+		mask &= matchMaskScalar(routing_table.guildDbIdColumn() + begin_slot, m_guild_db_id);
+	}
+	if (m_use_community_id)
+	{
+		mask &= matchMaskScalar(routing_table.communityIdColumn() + begin_slot, m_community_id);
+	}
+	return mask;
+}
@@ -0,0 +1,136 @@
+//
+#pragma once
+
+#include "BitOps.h"
+#include "SessionRoutingTable.h"
+
+/**
+라우팅 테이블 slot 단위 비트맵, 검색 결과로 사용한다.
+broadcast, 운영툴 등에서 forEach로 slot을 받아 sessionId로 변환하여 사용한다.
+*/
+class SessionSlotBitmap
+{
+public:
+	void reset(uint32_t slot_count)
+	{
+		m_words.assign((slot_count + 63) / 64, 0);
+	}
+
+	void set(uint32_t slot)
+	{
+		m_words[slot >> 6] |= (uint64_t(1) << (slot & 63));
+	}
+
+	bool test(uint32_t slot) const
+	{
+		return 0 != (m_words[slot >> 6] & (uint64_t(1) << (slot & 63)));
+	}
+
+	uint32_t count() const;
+
+	/// 켜진 slot을 순서대로 전달한다.
+	template <typename FUNC>
+	void forEach(FUNC func) const
+	{
+		for (size_t index = 0; index < m_words.size(); ++index)
+		{
+			uint64_t word = m_words[index];
+			while (0 != word)
+			{
+				uint32_t bit = countTrailingZero64(word);
+				func(static_cast<uint32_t>(index * 64 + bit));
+				word &= (word - 1);
+			}
+		}
+	}
+
+	std::vector<uint64_t> &words()
+	{
+		return m_words;
+	}
+
+	const std::vector<uint64_t> &words() const
+	{
+		return m_words;
+	}
+
+private:
+	std::vector<uint64_t> m_words;
+};
+
+/**
+라우팅 테이블 컬럼에 대한 일괄 검색 조건, 지정한 조건은 모두 만족(AND)해야 한다.
+ex) 로직서버 X, 존 Y에 있는 인증된 사용자
+	SessionRoutingFilter().whereLogicServerId(x).whereZoneServerId(y).whereSessionState(session_state_e::session_certified)
+*/
+class SessionRoutingFilter
+{
+public:
+	SessionRoutingFilter &whereSessionState(uint8_t session_state)
+	{
+		m_use_session_state = true;
+		m_session_state = session_state;
+		return *this;
+	}
+
+	SessionRoutingFilter &whereSessionType(uint8_t session_type)
+	{
+		m_use_session_type = true;
+		m_session_type = session_type;
+		return *this;
+	}
+
+	SessionRoutingFilter &whereLogicServerId(uint16_t logic_server_id)
+	{
+		m_use_logic_server_id = true;
+		m_logic_server_id = logic_server_id;
+		return *this;
+	}
+
+	SessionRoutingFilter &whereZoneServerId(uint16_t zone_server_id)
+	{
+		m_use_zone_server_id = true;
+		m_zone_server_id = zone_server_id;
+		return *this;
+	}
+
+	SessionRoutingFilter &whereGuildDbId(int32_t guild_db_id)
+	{
+		m_use_guild_db_id = true;
+		m_guild_db_id = guild_db_id;
+		return *this;
+	}
+
+	SessionRoutingFilter &whereCommunityId(int32_t community_id)
+	{
+		m_use_community_id = true;
+		m_community_id = community_id;
+		return *this;
+	}
+
+public:
+	/// 사용중인 slot 중 조건에 맞는 slot을 out_bitmap에 켠다. AVX2 빌드면 32개씩 비교한다.
+	void scan(const SessionRoutingTable &routing_table, _out SessionSlotBitmap &out_bitmap) const;
+
+	/// 비교용 scalar 구현
+	void scanScalar(const SessionRoutingTable &routing_table, _out SessionSlotBitmap &out_bitmap) const;
+
+private:
+	uint32_t matchBlock(const SessionRoutingTable &routing_table, uint32_t begin_slot) const;
+	uint32_t matchBlockScalar(const SessionRoutingTable &routing_table, uint32_t begin_slot) const;
+
+private:
+	bool m_use_session_state{false};
+	bool m_use_session_type{false};
+	bool m_use_logic_server_id{false};
+	bool m_use_zone_server_id{false};
+	bool m_use_guild_db_id{false};
+	bool m_use_community_id{false};
+
+	uint8_t m_session_state{0};
+	uint8_t m_session_type{0};
+	uint16_t m_logic_server_id{0};
+	uint16_t m_zone_server_id{0};
+	int32_t m_guild_db_id{0};
+	int32_t m_community_id{0};
+};
@@ -0,0 +1,385 @@
+//
+
+#include "preheader.h"
+
+#include "SessionRoutingSnapshot.h"
+#include <libGen/cpp/log/Logger.h>
+
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+
+namespace
+{
+	uint32_t crc32(const void *data, size_t size)
+	{
+		boost::crc_32_type crc;
+		crc.process_bytes(data, size);
+		return crc.checksum();
+	}
+} // namespace
+
+SessionRoutingSnapshot::SessionRoutingSnapshot()
+{
+	setDefaultLoggerName("session.snapshot");
+}
+
+SessionRoutingSnapshot::~SessionRoutingSnapshot()
+{
+	stop();
+}
+
+gplat::Result SessionRoutingSnapshot::start(const string_t &file_path, SessionRoutingTable &routing_table, float save_interval_sec)
+{
+	gplat::Result gen_result = open(file_path, routing_table);
+	if (gen_result.fail())
+	{
+		return gen_result;
+	}
+
+	m_stop = false;
+	m_save_thread = std::thread([this, save_interval_sec]() { run(save_interval_sec); });
+	return gen_result.setOk();
+}
+
+void SessionRoutingSnapshot::stop()
+{
+	if (!m_save_thread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_stop_mutex);
+		m_stop = true;
+	}
+	m_stop_condition.notify_all();
+	m_save_thread.join();
+
+	gplat::Result gen_result = save();
+	if (gen_result.fail())
+	{
+		LOG_ERROR("snapshot last save failed. {0}", gen_result.toString());
+	}
+}
+
+void SessionRoutingSnapshot::run(float save_interval_sec)
+{
+	auto save_interval = std::chrono::milliseconds(static_cast<int64_t>(save_interval_sec * 1000.0f));
+	std::unique_lock<std::mutex> lock(m_stop_mutex);
+	while (!m_stop_condition.wait_for(lock, save_interval, [this]() { return m_stop; }))
+	{
+		lock.unlock();
+		gplat::Result gen_result = save();
+		if (gen_result.fail())
+		{
+			LOG_ERROR("snapshot save failed. {0}", gen_result.toString());
+		}
+		lock.lock();
+	}
+}
+
+gplat::Result SessionRoutingSnapshot::open(const string_t &file_path, SessionRoutingTable &routing_table)
+{
+	gplat::Result gen_result;
+	namespace bip = boost::interprocess;
+
+	// 기록하기 전에 이전 실행의 스냅샷을 먼저 읽는다.
+	gplat::Result load_result = load(file_path);
+	if (load_result.fail())
+	{
+		LOG_INFO("previous snapshot not restored. {0}", load_result.toString());
+	}
+
+	m_file_path = file_path;
+	m_routing_table = &routing_table;
+
+	uint32_t capacity = routing_table.capacity();
+	size_t file_size = fileSize(capacity);
+	{
+		// 크기가 다르면 새로 만든다.
+		std::ifstream exist_file(file_path, std::ios::binary | std::ios::ate);
+		if (!exist_file || static_cast<size_t>(exist_file.tellg()) != file_size)
+		{
+			exist_file.close();
+			std::ofstream new_file(file_path, std::ios::binary | std::ios::trunc);
+			if (!new_file)
+			{
+				return gen_result.setFail(sformat("snapshot file create failed:{0}", file_path));
+			}
+			new_file.seekp(file_size - 1);
+			new_file.put(0);
+		}
+	}
+
+	try
+	{
+		m_file = bip::file_mapping(file_path.c_str(), bip::read_write);
+		m_region = bip::mapped_region(m_file, bip::read_write, 0, file_size);
+	}
+	catch (const bip::interprocess_exception &ex)
+	{
+		return gen_result.setFail(sformat("snapshot file map failed:{0} {1}", file_path, ex.what()));
+	}
+
+	void *base = m_region.get_address();
+	file_header_t *file_header = header(base);
+	bool same_format = (MAGIC == file_header->m_magic && VERSION == file_header->m_version && capacity == file_header->m_capacity);
+
+	// seq는 이어서 쓰되, 다음 기록이 완전한 최신 영역을 덮어쓰지 않게 한다.
+	m_seq = 0;
+	uint64_t complete_seq = 0;
+	for (uint32_t area_index = 0; same_format && area_index < AREA_COUNT; ++area_index)
+	{
+		const area_header_t *area_header = areaHeader(base, capacity, area_index);
+		m_seq = std::max(m_seq, std::max(area_header->m_seq_begin, area_header->m_seq_end));
+		string_t error;
+		complete_seq = std::max(complete_seq, verifyArea(base, capacity, area_index, error));
+	}
+	if (0 < complete_seq && areaIndex(m_seq + 1) == areaIndex(complete_seq))
+	{
+		++m_seq;
+	}
+
+	file_header->m_magic = MAGIC;
+	file_header->m_version = VERSION;
+	file_header->m_capacity = capacity;
+	file_header->m_record_size = sizeof(record_t);
+
+	// 영역마다 현재 테이블 전체를 한번씩 기록해야 한다.
+	for (auto &area_dirty : m_area_dirty)
+	{
+		area_dirty.assign(blockCount(capacity), 1);
+	}
+
+	LOG_INFO("snapshot opened:{0} capacity:{1} size:{2} seq:{3}", file_path, capacity, file_size, m_seq);
+	return gen_result.setOk();
+}
+
+gplat::Result SessionRoutingSnapshot::save()
+{
+	gplat::Result gen_result;
+	spin_mutex_t::scoped_lock lock(m_save_mutex);
+	if (!m_routing_table || !m_region.get_address())
+	{
+		return gen_result.setFail("snapshot not opened");
+	}
+
+	// 변경된 block은 두 영역 모두에 기록해야 한다.
+	m_routing_table->takeDirtyBlocks(m_dirty_block_indexes);
+	for (auto block_index : m_dirty_block_indexes)
+	{
+		for (auto &area_dirty : m_area_dirty)
+		{
+			area_dirty[block_index] = 1;
+		}
+	}
+
+	uint32_t area_index = areaIndex(m_seq + 1);
+	std::vector<uint8_t> &area_dirty = m_area_dirty[area_index];
+	if (std::find(area_dirty.begin(), area_dirty.end(), 1) == area_dirty.end())
+	{
+		return gen_result.setOk();
+	}
+
+	void *base = m_region.get_address();
+	uint32_t capacity = m_routing_table->capacity();
+	area_header_t *area_header = areaHeader(base, capacity, area_index);
+	uint32_t *block_crcs = blockCrcs(base, capacity, area_index);
+	record_t *file_records = records(base, capacity, area_index);
+
+	// 기록 시작, 중간에 죽으면 이 영역은 seq_begin != seq_end로 남고 다른 영역은 그대로다.
+	area_header->m_seq_begin = ++m_seq;
+	std::atomic_thread_fence(std::memory_order_release);
+
+	uint32_t written_block_count = 0;
+	for (uint32_t block_index = 0; block_index < blockCount(capacity); ++block_index)
+	{
+		if (0 == area_dirty[block_index])
+		{
+			continue;
+		}
+		area_dirty[block_index] = 0;
+		++written_block_count;
+
+		uint32_t begin_slot = block_index * SessionRoutingTable::BLOCK_SLOT_COUNT;
+		record_t *block_records = file_records + begin_slot;
+		for (uint32_t offset = 0; offset < SessionRoutingTable::BLOCK_SLOT_COUNT; ++offset)
+		{
+			auto route = m_routing_table->route(begin_slot + offset);
+			record_t &record = block_records[offset];
+			record.m_account_db_id = route.m_account_db_id;
+			record.m_guild_db_id = route.m_guild_db_id;
+			record.m_community_id = route.m_community_id;
+			record.m_channel_server_id = route.m_channel_server_id;
+			record.m_logic_server_id = route.m_logic_server_id;
+			record.m_zone_server_id = route.m_zone_server_id;
+			record.m_session_type = route.m_session_type;
+			record.m_occupied = m_routing_table->isOccupied(begin_slot + offset) ? 1 : 0;
+		}
+		block_crcs[block_index] = crc32(block_records, sizeof(record_t) * SessionRoutingTable::BLOCK_SLOT_COUNT);
+	}
+
+	area_header->m_block_crc_crc = crc32(block_crcs, sizeof(uint32_t) * blockCount(capacity));
+	area_header->m_saved_time = static_cast<int64_t>(std::time(nullptr));
+
+	std::atomic_thread_fence(std::memory_order_release);
+	area_header->m_seq_end = m_seq; // 기록 완료
+
+	if (!m_region.flush())
+	{
+		return gen_result.setFail(sformat("snapshot flush failed:{0}", m_file_path));
+	}
+
+	LOG_TRACE("snapshot saved seq:{0} area:{1} block_count:{2}", m_seq, area_index, written_block_count);
+	return gen_result.setOk();
+}
+
+uint64_t SessionRoutingSnapshot::verifyArea(void *base, uint32_t capacity, uint32_t area_index, _out string_t &error)
+{
+	const area_header_t *area_header = areaHeader(base, capacity, area_index);
+	if (0 == area_header->m_seq_end || area_header->m_seq_begin != area_header->m_seq_end)
+	{
+		error = sformat("area:{0} incomplete. seq_begin:{1} seq_end:{2}", area_index, area_header->m_seq_begin, area_header->m_seq_end);
+		return 0;
+	}
+
+	const uint32_t *block_crcs = blockCrcs(base, capacity, area_index);
+	if (crc32(block_crcs, sizeof(uint32_t) * blockCount(capacity)) != area_header->m_block_crc_crc)
+	{
+		error = sformat("area:{0} block crc corrupted", area_index);
+		return 0;
+	}
+
+	const record_t *file_records = records(base, capacity, area_index);
+	for (uint32_t block_index = 0; block_index < blockCount(capacity); ++block_index)
+	{
+		const record_t *block_records = file_records + block_index * SessionRoutingTable::BLOCK_SLOT_COUNT;
+		if (crc32(block_records, sizeof(record_t) * SessionRoutingTable::BLOCK_SLOT_COUNT) != block_crcs[block_index])
+		{
+			error = sformat("area:{0} record corrupted. block_index:{1}", area_index, block_index);
+			return 0;
+		}
+	}
+	return area_header->m_seq_end;
+}
+
+gplat::Result SessionRoutingSnapshot::load(const string_t &file_path)
+{
+	gplat::Result gen_result;
+	namespace bip = boost::interprocess;
+
+	bip::file_mapping file;
+	bip::mapped_region region;
+	try
+	{
+		file = bip::file_mapping(file_path.c_str(), bip::read_only);
+		region = bip::mapped_region(file, bip::read_only);
+	}
+	catch (const bip::interprocess_exception &ex)
+	{
+		return gen_result.setFail(sformat("snapshot file not loaded:{0} {1}", file_path, ex.what()));
+	}
+
+	void *base = region.get_address();
+	size_t region_size = region.get_size();
+	if (region_size < sizeof(file_header_t))
+	{
+		return gen_result.setFail(sformat("snapshot file too small:{0}", region_size));
+	}
+
+	const file_header_t *file_header = header(base);
+	if (MAGIC != file_header->m_magic || VERSION != file_header->m_version || sizeof(record_t) != file_header->m_record_size)
+	{
+		return gen_result.setFail(sformat("snapshot file invalid format. magic:{0} version:{1}", file_header->m_magic, file_header->m_version));
+	}
+
+	uint32_t capacity = file_header->m_capacity;
+	if (0 != capacity % SessionRoutingTable::BLOCK_SLOT_COUNT || fileSize(capacity) != region_size)
+	{
+		return gen_result.setFail(sformat("snapshot file size mismatch. capacity:{0} size:{1}", capacity, region_size));
+	}
+
+	// 완전한 영역 중 최신 것을 쓴다.
+	uint64_t load_seq = 0;
+	uint32_t load_area_index = 0;
+	string_t errors;
+	for (uint32_t area_index = 0; area_index < AREA_COUNT; ++area_index)
+	{
+		string_t error;
+		uint64_t seq = verifyArea(base, capacity, area_index, error);
+		if (0 == seq)
+		{
+			errors += error + " ";
+			continue;
+		}
+		if (seq > load_seq)
+		{
+			load_seq = seq;
+			load_area_index = area_index;
+		}
+	}
+	if (0 == load_seq)
+	{
+		return gen_result.setFail(sformat("snapshot file has no complete area. {0}", errors));
+	}
+	if (!errors.empty())
+	{
+		LOG_WARN("snapshot area skipped. {0}", errors);
+	}
+
+	const record_t *file_records = records(base, capacity, load_area_index);
+	std::unordered_map<int64_t, resume_t> resumes;
+	for (uint32_t slot = 0; slot < capacity; ++slot)
+	{
+		const record_t &record = file_records[slot];
+		if (0 == record.m_occupied || 0 == record.m_account_db_id)
+		{
+			continue;
+		}
+
+		resume_t &resume = resumes[record.m_account_db_id];
+		resume.m_channel_server_id = record.m_channel_server_id;
+		resume.m_logic_server_id = record.m_logic_server_id;
+		resume.m_zone_server_id = record.m_zone_server_id;
+		resume.m_guild_db_id = record.m_guild_db_id;
+		resume.m_community_id = record.m_community_id;
+	}
+
+	size_t resume_count = resumes.size();
+	{
+		spin_mutex_t::scoped_lock lock(m_resumes_mutex);
+		m_resumes.swap(resumes);
+	}
+
+	LOG_INFO("snapshot loaded:{0} seq:{1} area:{2} resume_count:{3}", file_path, load_seq, load_area_index, resume_count);
+	return gen_result.setOk();
+}
+
+bool SessionRoutingSnapshot::findResume(int64_t account_db_id, _out resume_t &resume) const
+{
+	spin_mutex_t::scoped_lock lock(m_resumes_mutex);
+	auto it = m_resumes.find(account_db_id);
+	if (it == m_resumes.end())
+	{
+		return false;
+	}
+	resume = it->second;
+	return true;
+}
+
+bool SessionRoutingSnapshot::takeResume(int64_t account_db_id, _out resume_t &resume)
+{
+	spin_mutex_t::scoped_lock lock(m_resumes_mutex);
+	auto it = m_resumes.find(account_db_id);
+	if (it == m_resumes.end())
+	{
+		return false;
+	}
+	resume = it->second;
+	m_resumes.erase(it);
+	return true;
+}
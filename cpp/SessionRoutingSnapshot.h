@@ -0,0 +1,179 @@
+//
+#pragma once
+
+#include "SessionRoutingTable.h"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/**
+채널서버 재시작시 사용자 라우팅 정보를 복구하기 위한 스냅샷 파일
+- SessionRoutingTable을 memory-mapped 파일에 주기적으로 기록한다. 변경된 block만 복사한다.
+- 파일 안에 스냅샷 영역이 두개(A/B) 있고 번갈아 기록한다. 기록 중 죽어도 다른 영역의 직전 스냅샷은 남는다.
+- 영역별로 기록 시작/종료 seq를 남겨서 기록 중 죽은 영역은 복구하지 않는다.
+- block별 crc와 block crc 전체에 대한 crc로 파일 손상을 검사한다.
+- 재시작시 open에서 이전 스냅샷을 먼저 읽은 후 기록을 시작한다.
+- account_db_id를 키로 복구 정보를 만들고, 재접속한 사용자 인증시(Session::setCertified) takeResume으로 꺼내 쓴다.
+*/
+class SessionRoutingSnapshot
+	: public LoggerBaseInfo
+{
+public:
+	static const uint32_t MAGIC = 0x4E535253; // "SRSN"
+	static const uint32_t VERSION = 2;
+	static const uint32_t AREA_COUNT = 2;
+
+#pragma pack(push, 1)
+	struct file_header_t
+	{
+		uint32_t m_magic;
+		uint32_t m_version;
+		uint32_t m_capacity;
+		uint32_t m_record_size;
+	};
+
+	/// 영역별 헤더, 뒤에 block crc * block 수, record * capacity가 이어진다.
+	struct area_header_t
+	{
+		uint64_t m_seq_begin; ///< 기록 시작시 증가
+		uint64_t m_seq_end;	  ///< 기록 완료시 m_seq_begin과 같게 한다.
+		uint32_t m_block_crc_crc;
+		uint32_t m_reserved;
+		int64_t m_saved_time;
+	};
+
+	struct record_t
+	{
+		int64_t m_account_db_id;
+		int32_t m_guild_db_id;
+		int32_t m_community_id;
+		uint16_t m_channel_server_id;
+		uint16_t m_logic_server_id;
+		uint16_t m_zone_server_id;
+		uint8_t m_session_type;
+		uint8_t m_occupied;
+	};
+#pragma pack(pop)
+
+	/// 재접속 사용자에게 돌려줄 라우팅 정보
+	struct resume_t
+	{
+		uint16_t m_channel_server_id{0};
+		uint16_t m_logic_server_id{0};
+		uint16_t m_zone_server_id{0};
+		int32_t m_guild_db_id{0};
+		int32_t m_community_id{0};
+	};
+
+public:
+	SessionRoutingSnapshot();
+	~SessionRoutingSnapshot();
+
+	static SessionRoutingSnapshot &instance()
+	{
+		static SessionRoutingSnapshot s_instance;
+		return s_instance;
+	}
+
+public:
+	/// 서버 시작시 호출, open 후 save_interval_sec마다 저장하는 스레드를 띄운다.
+	gplat::Result start(const string_t &file_path, SessionRoutingTable &routing_table, float save_interval_sec);
+
+	/// 마지막으로 저장하고 스레드를 멈춘다.
+	void stop();
+
+	/// 이전 스냅샷을 읽어 복구 정보를 만든 후 기록용으로 map 한다. 파일이 없거나 크기가 다르면 새로 만든다.
+	gplat::Result open(const string_t &file_path, SessionRoutingTable &routing_table);
+
+	/// 변경된 block을 직전 스냅샷이 없는 영역에 기록한다. 주기적으로 호출
+	gplat::Result save();
+
+	/// 스냅샷 파일을 검증하고 사용자 복구 정보를 읽어들인다. 두 영역 중 완전한 최신 영역을 사용한다.
+	gplat::Result load(const string_t &file_path);
+
+	bool findResume(int64_t account_db_id, _out resume_t &resume) const;
+
+	/// 복구 정보를 한번만 쓰도록 꺼내면서 지운다.
+	bool takeResume(int64_t account_db_id, _out resume_t &resume);
+
+	size_t resumeCount() const
+	{
+		spin_mutex_t::scoped_lock lock(m_resumes_mutex);
+		return m_resumes.size();
+	}
+
+	uint64_t lastSavedSeq() const
+	{
+		return m_seq;
+	}
+
+private:
+	static uint32_t blockCount(uint32_t capacity)
+	{
+		return capacity / SessionRoutingTable::BLOCK_SLOT_COUNT;
+	}
+
+	static size_t areaSize(uint32_t capacity)
+	{
+		return sizeof(area_header_t) + sizeof(uint32_t) * blockCount(capacity) + sizeof(record_t) * capacity;
+	}
+
+	static size_t fileSize(uint32_t capacity)
+	{
+		return sizeof(file_header_t) + areaSize(capacity) * AREA_COUNT;
+	}
+
+	static file_header_t *header(void *base)
+	{
+		return static_cast<file_header_t *>(base);
+	}
+
+	/// seq가 홀수면 0번, 짝수면 1번 영역에 기록한다.
+	static uint32_t areaIndex(uint64_t seq)
+	{
+		return static_cast<uint32_t>((seq + 1) % AREA_COUNT);
+	}
+
+	static area_header_t *areaHeader(void *base, uint32_t capacity, uint32_t area_index)
+	{
+		return reinterpret_cast<area_header_t *>(static_cast<char *>(base) + sizeof(file_header_t) + areaSize(capacity) * area_index);
+	}
+
+	static uint32_t *blockCrcs(void *base, uint32_t capacity, uint32_t area_index)
+	{
+		return reinterpret_cast<uint32_t *>(areaHeader(base, capacity, area_index) + 1);
+	}
+
+	static record_t *records(void *base, uint32_t capacity, uint32_t area_index)
+	{
+		return reinterpret_cast<record_t *>(blockCrcs(base, capacity, area_index) + blockCount(capacity));
+	}
+
+	/// 영역 검증 후 완료된 seq, 사용할 수 없으면 0
+	static uint64_t verifyArea(void *base, uint32_t capacity, uint32_t area_index, _out string_t &error);
+
+	void run(float save_interval_sec);
+
+private:
+	string_t m_file_path;
+	SessionRoutingTable *m_routing_table{nullptr};
+
+	boost::interprocess::file_mapping m_file;
+	boost::interprocess::mapped_region m_region;
+
+	uint64_t m_seq{0};
+	std::vector<uint32_t> m_dirty_block_indexes;
+	std::vector<uint8_t> m_area_dirty[AREA_COUNT]; ///< 영역별로 아직 기록하지 않은 block
+	spin_mutex_t m_save_mutex;
+
+	std::unordered_map<int64_t, resume_t> m_resumes;
+	mutable spin_mutex_t m_resumes_mutex;
+
+	std::thread m_save_thread;
+	std::mutex m_stop_mutex;
+	std::condition_variable m_stop_condition;
+	bool m_stop{false};
+};
@@ -0,0 +1,353 @@
+//
+#pragma once
+
+#include "Concurrency.h"
+#include "BitOps.h"
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+/**
+세션 릴레이에 필요한 라우팅 필드만 모아둔 테이블 (struct of arrays)
+- Session 객체는 소켓, 문자열, 로거등을 들고 있어서 크고 힙에 흩어져 있다.
+- 릴레이/라우팅 경로는 Session을 따라가지 않고 slot 번호로 이 테이블만 읽는다.
+- slot은 Session::init에서 할당, onClose에서 반환한다.
+- 용량은 생성시 고정한다. 실행 중 재할당이 없으므로 릴레이/일괄 검색/스냅샷은 잠금 없이 읽는다.
+  읽는 도중 slot이 반환/재사용될 수 있으므로 검색 결과는 sessionId로 세션을 다시 찾아서 사용한다.
+- 쓰기(할당, 반환, 갱신)는 잠금 후 slot 소유 session_id를 확인하여 재사용된 slot을 덮어쓰지 않는다.
+- 컬럼은 relaxed atomic으로 읽고 쓴다. 64개 block마다 version(seqlock)을 두어 쓰는 동안 홀수로 만들고,
+  여러 필드/slot을 한번에 읽는 쪽(route, 일괄 검색)은 version이 바뀌었으면 다시 읽는다.
+- 용량은 64의 배수로 올림하여 일괄 검색(SessionRoutingFilter)이 꼬리 처리 없이 32개 단위로 읽을 수 있게 한다.
+- 변경된 slot은 64개 단위 block으로 dirty 표시하여 스냅샷(SessionRoutingSnapshot)이 변경분만 기록하게 한다.
+*/
+class SessionRoutingTable
+{
+public:
+	static const uint32_t INVALID_SLOT = 0xFFFFFFFF;
+	static const uint32_t DEFAULT_CAPACITY = 1 << 18;
+	static const uint32_t BLOCK_SLOT_COUNT = 64;
+
+	/// 하나의 slot에 해당하는 라우팅 정보 (복사용)
+	struct route_t
+	{
+		uint64_t m_session_id{0};
+		uint16_t m_channel_server_id{0};
+		uint16_t m_logic_server_id{0};
+		uint16_t m_zone_server_id{0};
+		uint8_t m_session_type{0};
+		uint8_t m_session_state{0};
+		int64_t m_account_db_id{0};
+		int32_t m_guild_db_id{0};
+		int32_t m_community_id{0};
+	};
+
+public:
+	explicit SessionRoutingTable(uint32_t capacity = DEFAULT_CAPACITY)
+	{
+		capacity = (capacity + 63) & ~63u;
+		m_capacity = capacity;
+
+		allocColumn(m_session_id, capacity);
+		allocColumn(m_channel_server_id, capacity);
+		allocColumn(m_logic_server_id, capacity);
+		allocColumn(m_zone_server_id, capacity);
+		allocColumn(m_session_type, capacity);
+		allocColumn(m_session_state, capacity);
+		allocColumn(m_occupied, capacity);
+		allocColumn(m_account_db_id, capacity);
+		allocColumn(m_guild_db_id, capacity);
+		allocColumn(m_community_id, capacity);
+		allocColumn(m_block_versions, blockCount());
+
+		m_dirty_word_count = (blockCount() + 63) / 64;
+		m_dirty_blocks.reset(new std::atomic<uint64_t>[m_dirty_word_count]);
+		for (uint32_t index = 0; index < m_dirty_word_count; ++index)
+		{
+			m_dirty_blocks[index].store(0, std::memory_order_relaxed);
+		}
+
+		// 낮은 slot부터 쓰도록 역순으로 넣어둔다.
+		m_free_slots.reserve(capacity);
+		for (uint32_t slot = capacity; slot > 0; --slot)
+		{
+			m_free_slots.push_back(slot - 1);
+		}
+	}
+
+	static SessionRoutingTable &instance()
+	{
+		static SessionRoutingTable s_instance;
+		return s_instance;
+	}
+
+public:
+	/// 용량이 다 찬 경우 INVALID_SLOT, 호출측은 Session 멤버를 그대로 사용한다.
+	uint32_t allocSlot(uint64_t session_id)
+	{
+		spin_mutex_t::scoped_lock lock(m_slots_mutex);
+		if (m_free_slots.empty())
+		{
+			return INVALID_SLOT;
+		}
+		uint32_t slot = m_free_slots.back();
+		m_free_slots.pop_back();
+
+		beginWrite(slot);
+		store(m_session_id, slot, session_id);
+		store(m_occupied, slot, 1);
+		endWrite(slot);
+		m_used_count.fetch_add(1, std::memory_order_relaxed);
+		return slot;
+	}
+
+	/// slot을 할당받은 session_id인 경우에만 반환한다.
+	void freeSlot(uint32_t slot, uint64_t session_id)
+	{
+		if (!isValidSlot(slot))
+		{
+			return;
+		}
+
+		spin_mutex_t::scoped_lock lock(m_slots_mutex);
+		if (!isOwner(slot, session_id))
+		{
+			return;
+		}
+		beginWrite(slot);
+		store(m_occupied, slot, 0);
+		store(m_session_id, slot, 0);
+		storeRoute(slot, route_t());
+		endWrite(slot);
+
+		m_free_slots.push_back(slot);
+		m_used_count.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	bool isValidSlot(uint32_t slot) const
+	{
+		return slot < m_capacity;
+	}
+
+	/// slot을 할당받은 session_id인 경우에만 갱신한다. 반환/재사용된 slot이면 false
+	bool update(uint32_t slot, uint64_t session_id, const route_t &route)
+	{
+		if (!isValidSlot(slot))
+		{
+			return false;
+		}
+
+		spin_mutex_t::scoped_lock lock(m_slots_mutex);
+		if (!isOwner(slot, session_id))
+		{
+			return false;
+		}
+		beginWrite(slot);
+		storeRoute(slot, route);
+		endWrite(slot);
+		return true;
+	}
+
+	/// 한 slot의 필드를 한번에 복사한다. 잠그지 않고 block version이 바뀌면 다시 읽는다.
+	route_t route(uint32_t slot) const
+	{
+		route_t route;
+		uint32_t block_index = slot / BLOCK_SLOT_COUNT;
+		uint32_t version = 0;
+		do
+		{
+			version = readBlockBegin(block_index);
+			route.m_session_id = load(m_session_id, slot);
+			route.m_channel_server_id = load(m_channel_server_id, slot);
+			route.m_logic_server_id = load(m_logic_server_id, slot);
+			route.m_zone_server_id = load(m_zone_server_id, slot);
+			route.m_session_type = load(m_session_type, slot);
+			route.m_session_state = load(m_session_state, slot);
+			route.m_account_db_id = load(m_account_db_id, slot);
+			route.m_guild_db_id = load(m_guild_db_id, slot);
+			route.m_community_id = load(m_community_id, slot);
+		} while (readBlockRetry(block_index, version));
+		return route;
+	}
+
+	/// 릴레이용, slot을 session_id가 소유하고 있으면 route를 복사한다. 반환/재사용된 slot이면 false
+	bool ownedRoute(uint32_t slot, uint64_t session_id, _out route_t &out_route) const
+	{
+		if (!isValidSlot(slot))
+		{
+			return false;
+		}
+		out_route = route(slot);
+		return session_id == out_route.m_session_id;
+	}
+
+public:
+	uint64_t sessionId(uint32_t slot) const { return load(m_session_id, slot); }
+	uint16_t channelServerId(uint32_t slot) const { return load(m_channel_server_id, slot); }
+	uint16_t logicServerId(uint32_t slot) const { return load(m_logic_server_id, slot); }
+	uint16_t zoneServerId(uint32_t slot) const { return load(m_zone_server_id, slot); }
+	uint8_t sessionType(uint32_t slot) const { return load(m_session_type, slot); }
+	uint8_t sessionState(uint32_t slot) const { return load(m_session_state, slot); }
+	bool isOccupied(uint32_t slot) const { return 0 != load(m_occupied, slot); }
+	int64_t accountDbId(uint32_t slot) const { return load(m_account_db_id, slot); }
+
+	/// 일괄 검색용 컬럼, 길이는 capacity()
+	/// block 단위로 readBlockBegin/readBlockRetry 사이에서 읽는다. SIMD로 읽을 수 있게 atomic은 값과 같은 크기여야 한다.
+	const std::atomic<uint8_t> *occupiedColumn() const { return m_occupied.get(); }
+	const std::atomic<uint8_t> *sessionTypeColumn() const { return m_session_type.get(); }
+	const std::atomic<uint8_t> *sessionStateColumn() const { return m_session_state.get(); }
+	const std::atomic<uint16_t> *logicServerIdColumn() const { return m_logic_server_id.get(); }
+	const std::atomic<uint16_t> *zoneServerIdColumn() const { return m_zone_server_id.get(); }
+	const std::atomic<int32_t> *guildDbIdColumn() const { return m_guild_db_id.get(); }
+	const std::atomic<int32_t> *communityIdColumn() const { return m_community_id.get(); }
+
+	/// block 읽기 시작, 쓰는 중(홀수)이면 끝날 때까지 기다린다.
+	uint32_t readBlockBegin(uint32_t block_index) const
+	{
+		for (;;)
+		{
+			uint32_t version = m_block_versions[block_index].load(std::memory_order_acquire);
+			if (0 == (version & 1))
+			{
+				return version;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	/// 읽는 동안 block이 갱신되었으면 true, 다시 읽는다.
+	bool readBlockRetry(uint32_t block_index, uint32_t version) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return m_block_versions[block_index].load(std::memory_order_relaxed) != version;
+	}
+
+	uint32_t capacity() const
+	{
+		return m_capacity;
+	}
+
+	uint32_t usedCount() const
+	{
+		return m_used_count.load(std::memory_order_relaxed);
+	}
+
+	uint32_t blockCount() const
+	{
+		return m_capacity / BLOCK_SLOT_COUNT;
+	}
+
+	/// 마지막 호출 이후 변경된 block 번호를 꺼내고 dirty 표시를 지운다.
+	void takeDirtyBlocks(_out std::vector<uint32_t> &block_indexes)
+	{
+		block_indexes.clear();
+		for (uint32_t index = 0; index < m_dirty_word_count; ++index)
+		{
+			uint64_t word = m_dirty_blocks[index].exchange(0, std::memory_order_acq_rel);
+			while (0 != word)
+			{
+				uint32_t bit = countTrailingZero64(word);
+				block_indexes.push_back(index * 64 + bit);
+				word &= (word - 1);
+			}
+		}
+	}
+
+	/// 전체를 dirty로 표시, 스냅샷 파일을 새로 만드는 경우 사용
+	void markAllDirty()
+	{
+		for (uint32_t block_index = 0; block_index < blockCount(); ++block_index)
+		{
+			m_dirty_blocks[block_index >> 6].fetch_or(uint64_t(1) << (block_index & 63), std::memory_order_relaxed);
+		}
+	}
+
+private:
+	template <typename T>
+	using column_t = std::unique_ptr<std::atomic<T>[]>;
+
+	template <typename T>
+	static void allocColumn(_out column_t<T> &column, uint32_t count)
+	{
+		static_assert(sizeof(std::atomic<T>) == sizeof(T), "column must be readable as plain array");
+		column.reset(new std::atomic<T>[count]);
+		for (uint32_t index = 0; index < count; ++index)
+		{
+			column[index].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	template <typename T>
+	static T load(const column_t<T> &column, uint32_t slot)
+	{
+		return column[slot].load(std::memory_order_relaxed);
+	}
+
+	template <typename T, typename V>
+	static void store(column_t<T> &column, uint32_t slot, V value)
+	{
+		column[slot].store(static_cast<T>(value), std::memory_order_relaxed);
+	}
+
+	// m_slots_mutex 잠근 상태에서 호출
+	bool isOwner(uint32_t slot, uint64_t session_id) const
+	{
+		return 0 != load(m_occupied, slot) && session_id == load(m_session_id, slot);
+	}
+
+	// m_slots_mutex 잠근 상태에서 beginWrite/endWrite 사이에서 호출
+	void storeRoute(uint32_t slot, const route_t &route)
+	{
+		store(m_channel_server_id, slot, route.m_channel_server_id);
+		store(m_logic_server_id, slot, route.m_logic_server_id);
+		store(m_zone_server_id, slot, route.m_zone_server_id);
+		store(m_session_type, slot, route.m_session_type);
+		store(m_session_state, slot, route.m_session_state);
+		store(m_account_db_id, slot, route.m_account_db_id);
+		store(m_guild_db_id, slot, route.m_guild_db_id);
+		store(m_community_id, slot, route.m_community_id);
+	}
+
+	// m_slots_mutex 잠근 상태에서 호출, 쓰기는 잠금으로 직렬화되므로 version은 한 곳에서만 바뀐다.
+	void beginWrite(uint32_t slot)
+	{
+		auto &version = m_block_versions[slot / BLOCK_SLOT_COUNT];
+		version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	void endWrite(uint32_t slot)
+	{
+		auto &version = m_block_versions[slot / BLOCK_SLOT_COUNT];
+		version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		markDirty(slot);
+	}
+
+	void markDirty(uint32_t slot)
+	{
+		uint32_t block_index = slot / BLOCK_SLOT_COUNT;
+		m_dirty_blocks[block_index >> 6].fetch_or(uint64_t(1) << (block_index & 63), std::memory_order_relaxed);
+	}
+
+private:
+	uint32_t m_capacity{0};
+	std::atomic<uint32_t> m_used_count{0};
+
+	column_t<uint64_t> m_session_id;
+	column_t<uint16_t> m_channel_server_id;
+	column_t<uint16_t> m_logic_server_id;
+	column_t<uint16_t> m_zone_server_id;
+	column_t<uint8_t> m_session_type;
+	column_t<uint8_t> m_session_state;
+	column_t<uint8_t> m_occupied;
+	column_t<int64_t> m_account_db_id;
+	column_t<int32_t> m_guild_db_id;
+	column_t<int32_t> m_community_id;
+	column_t<uint32_t> m_block_versions; ///< block별 seqlock version
+
+	std::vector<uint32_t> m_free_slots;
+	mutable spin_mutex_t m_slots_mutex;
+
+	uint32_t m_dirty_word_count{0};
+	std::unique_ptr<std::atomic<uint64_t>[]> m_dirty_blocks;
+};
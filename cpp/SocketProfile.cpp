@@ -0,0 +1,175 @@
+//
+
+#include "preheader.h"
+
+#include "SocketProfile.h"
+#include "MetricsRegistry.h"
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace
+{
+#if defined(__linux__)
+	bool setRawOption(boost::asio::ip::tcp::socket &sock, int level, int name, int value)
+	{
+		return 0 == setsockopt(sock.native_handle(), level, name, &value, sizeof(value));
+	}
+#endif
+} // namespace
+
+gplat::Result SocketProfileRegistry::apply(boost::asio::ip::tcp::socket &sock, const socket_profile_t &profile)
+{
+	gplat::Result gen_result;
+	string_t failed_options;
+	boost::system::error_code boost_error_code;
+
+	// 다시 적용될 때 이전 profile 값이 남지 않도록 항상 설정한다.
+	sock.set_option(boost::asio::ip::tcp::no_delay(profile.m_no_delay), boost_error_code);
+	if (boost_error_code)
+	{
+		failed_options += "TCP_NODELAY ";
+	}
+	if (0 < profile.m_receive_buffer_size)
+	{
+		sock.set_option(boost::asio::socket_base::receive_buffer_size(profile.m_receive_buffer_size), boost_error_code);
+		if (boost_error_code)
+		{
+			failed_options += "SO_RCVBUF ";
+		}
+	}
+	if (0 < profile.m_send_buffer_size)
+	{
+		sock.set_option(boost::asio::socket_base::send_buffer_size(profile.m_send_buffer_size), boost_error_code);
+		if (boost_error_code)
+		{
+			failed_options += "SO_SNDBUF ";
+		}
+	}
+
+#if defined(__linux__)
+	if (profile.m_quick_ack && !setRawOption(sock, IPPROTO_TCP, TCP_QUICKACK, 1))
+	{
+		failed_options += "TCP_QUICKACK ";
+	}
+#if defined(SO_BUSY_POLL)
+	if (0 < profile.m_busy_poll_usec && !setRawOption(sock, SOL_SOCKET, SO_BUSY_POLL, profile.m_busy_poll_usec))
+	{
+		failed_options += "SO_BUSY_POLL "; // CAP_NET_ADMIN 없이 기본값보다 크게 설정하면 실패
+	}
+#endif
+#endif
+
+	if (!failed_options.empty())
+	{
+		return gen_result.setFail(sformat("socket option failed:{0}", failed_options));
+	}
+	return gen_result.setOk();
+}
+
+void SocketProfileRegistry::rearmQuickAck(boost::asio::ip::tcp::socket &sock)
+{
+#if defined(__linux__)
+	setRawOption(sock, IPPROTO_TCP, TCP_QUICKACK, 1);
+#endif
+}
+
+cork_scope_t::cork_scope_t(boost::asio::ip::tcp::socket *sock)
+	: m_sock(sock)
+{
+#if defined(__linux__)
+	if (m_sock && !setRawOption(*m_sock, IPPROTO_TCP, TCP_CORK, 1))
+	{
+		m_sock = nullptr;
+	}
+#else
+	m_sock = nullptr;
+#endif
+}
+
+cork_scope_t::~cork_scope_t()
+{
+#if defined(__linux__)
+	if (m_sock)
+	{
+		setRawOption(*m_sock, IPPROTO_TCP, TCP_CORK, 0); // 풀면서 모인 패킷을 바로 보낸다.
+	}
+#endif
+}
+
+void BusyPollRunner::start(int32_t thread_count)
+{
+	if (m_running.exchange(true))
+	{
+		return;
+	}
+
+	m_io_context.restart();
+	for (int32_t index = 0; index < thread_count; ++index)
+	{
+		m_threads.emplace_back([this]() { run(); });
+	}
+	LOG_INFO("busy poll runner started. thread_count:{0}", thread_count);
+}
+
+void BusyPollRunner::stop()
+{
+	if (!m_running.exchange(false))
+	{
+		return;
+	}
+
+	m_io_context.stop(); // run_one_for로 기다리는 스레드를 깨운다.
+	for (auto &thread : m_threads)
+	{
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+	m_threads.clear();
+	m_attached_count.store(0, std::memory_order_relaxed);
+	LOG_INFO("busy poll runner stopped.");
+}
+
+bool BusyPollRunner::attach(const gplat::asio::io_context &io_context)
+{
+	if (&io_context != &m_io_context)
+	{
+		return false;
+	}
+	uint32_t attached_count = m_attached_count.fetch_add(1, std::memory_order_relaxed) + 1;
+	LOG_INFO("session attached to busy poll runner. count:{0}", attached_count);
+	return true;
+}
+
+void BusyPollRunner::detach()
+{
+	// stop에서 비운 후 늦게 종료된 세션은 무시한다.
+	uint32_t attached_count = m_attached_count.load(std::memory_order_relaxed);
+	while (0 < attached_count && !m_attached_count.compare_exchange_weak(attached_count, attached_count - 1, std::memory_order_relaxed))
+	{
+	}
+}
+
+void BusyPollRunner::run()
+{
+	MetricsRegistry::instance().attachThread();
+
+	// 붙은 세션이 있으면 처리할 것이 없어도 잠들지 않고 다시 poll 한다.
+	auto work_guard = boost::asio::make_work_guard(m_io_context);
+	while (m_running.load(std::memory_order_relaxed))
+	{
+		if (0 < m_attached_count.load(std::memory_order_relaxed))
+		{
+			m_io_context.poll();
+		}
+		else
+		{
+			m_io_context.run_one_for(std::chrono::milliseconds(10));
+		}
+	}
+}
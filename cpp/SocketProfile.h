@@ -0,0 +1,158 @@
+//
+#pragma once
+
+#include "Concurrency.h"
+#include <atomic>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
+/**
+세션 종류별 소켓 옵션
+- 0 또는 false인 항목은 적용하지 않는다(OS 기본값 유지).
+- m_no_delay는 항상 적용한다. false이면 Nagle을 다시 켠다.
+- TCP_CORK, TCP_QUICKACK, SO_BUSY_POLL은 linux에서만 적용한다.
+- TCP_CORK는 소켓에 걸어두지 않고 송신 묶음 동안만 건다(cork_scope_t).
+- TCP_QUICKACK은 커널이 다시 지연 ack로 돌아갈 수 있다. 읽기 완료를 직접 받는 곳은 읽기 묶음마다 rearmQuickAck로 다시 건다.
+- m_run_to_completion 세션은 BusyPollRunner::instance().ioContext()에서 만들어야 하며 그 runner에 붙는다.
+*/
+struct socket_profile_t
+{
+	bool m_no_delay{true};		   ///< TCP_NODELAY
+	bool m_cork{false};			   ///< TCP_CORK, 송신 묶음의 작은 패킷을 모아서 보낸다.
+	int32_t m_receive_buffer_size{0}; ///< SO_RCVBUF
+	int32_t m_send_buffer_size{0};	   ///< SO_SNDBUF
+	bool m_quick_ack{false};		   ///< TCP_QUICKACK, 지연 ack 끄기
+	int32_t m_busy_poll_usec{0};	   ///< SO_BUSY_POLL
+	bool m_run_to_completion{false};   ///< 전용 스레드 busy poll 대상
+};
+
+/// 범위 안의 송신을 TCP_CORK로 묶고 벗어날 때 풀어서 바로 내보낸다. sock이 nullptr이면 아무것도 하지 않는다.
+/// 비동기 쓰기가 범위를 벗어난 후 일어나면 묶이지 않을 뿐 지연되지는 않는다.
+class cork_scope_t
+{
+public:
+	explicit cork_scope_t(boost::asio::ip::tcp::socket *sock);
+	~cork_scope_t();
+
+	cork_scope_t(const cork_scope_t &) = delete;
+	cork_scope_t &operator=(const cork_scope_t &) = delete;
+
+private:
+	boost::asio::ip::tcp::socket *m_sock;
+};
+
+class SocketProfileRegistry
+{
+public:
+	static SocketProfileRegistry &instance()
+	{
+		static SocketProfileRegistry s_instance;
+		return s_instance;
+	}
+
+public:
+	/// 서버 시작시 세션 종류별로 지정, 지정하지 않은 종류는 기본 profile
+	void setProfile(int32_t session_type, const socket_profile_t &profile)
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		m_profiles[session_type] = profile;
+	}
+
+	void setDefaultProfile(const socket_profile_t &profile)
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		m_default_profile = profile;
+	}
+
+	socket_profile_t profile(int32_t session_type)
+	{
+		spin_mutex_t::scoped_lock lock(m_mutex);
+		auto it = m_profiles.find(session_type);
+		if (it == m_profiles.end())
+		{
+			return m_default_profile;
+		}
+		return it->second;
+	}
+
+	/// 소켓에 profile 적용, 실패한 옵션이 있으면 fail (나머지는 적용된다)
+	static gplat::Result apply(boost::asio::ip::tcp::socket &sock, const socket_profile_t &profile);
+
+	/// 읽기 완료 묶음마다 한번 호출, 지연 ack로 돌아간 소켓에 TCP_QUICKACK을 다시 건다. 패킷마다 부르지 않는다.
+	static void rearmQuickAck(boost::asio::ip::tcp::socket &sock);
+
+private:
+	SocketProfileRegistry() = default;
+
+private:
+	spin_mutex_t m_mutex;
+	std::map<int32_t, socket_profile_t> m_profiles; ///< session_type -> profile
+	socket_profile_t m_default_profile;
+};
+
+/**
+run-to-completion 모드
+- 전용 스레드가 자기 io_context를 잠들지 않고 poll 하여 서버간 세션의 지연을 줄인다.
+- 스레드 하나가 코어 하나를 계속 사용하므로 서버간 연결처럼 수가 적고 지연이 중요한 세션만 ioContext()에서 만든다.
+  다른 io_context는 poll 하지 않는다. 공유 io_context를 같이 돌리면 프로세스 전체가 busy poll 된다.
+- 세션이 attach 한 동안만 busy poll 하고, 붙은 세션이 없으면 run_one_for로 잠들며 기다린다.
+- 세션은 종료시 detach 한다. stop하면 붙은 세션 수를 비운다.
+*/
+class BusyPollRunner
+	: public LoggerBaseInfo
+{
+public:
+	static BusyPollRunner &instance()
+	{
+		static BusyPollRunner s_instance;
+		return s_instance;
+	}
+
+	BusyPollRunner()
+	{
+		setDefaultLoggerName("network.busypoll");
+	}
+
+	~BusyPollRunner()
+	{
+		stop();
+	}
+
+public:
+	void start(int32_t thread_count);
+	void stop();
+
+	/// run-to-completion 세션 시작, 세션 소켓의 io_context가 ioContext()가 아니면 붙이지 않고 false
+	bool attach(const gplat::asio::io_context &io_context);
+
+	/// attach 한 세션 종료
+	void detach();
+
+	gplat::asio::io_context &ioContext()
+	{
+		return m_io_context;
+	}
+
+	uint32_t attachedCount() const
+	{
+		return m_attached_count.load(std::memory_order_relaxed);
+	}
+
+	bool isRunning() const
+	{
+		return m_running.load(std::memory_order_relaxed);
+	}
+
+private:
+	void run();
+
+private:
+	gplat::asio::io_context m_io_context;
+	std::atomic<uint32_t> m_attached_count{0}; ///< 0이면 busy poll 하지 않는다.
+	std::atomic<bool> m_running{false};
+	std::vector<std::thread> m_threads;
+};
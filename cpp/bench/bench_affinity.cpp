@@ -0,0 +1,117 @@
+//
+// allocByAffinity 조회 비용과 서버 추가/제거시 키 이동 비율을 잰다.
+// 서버수별로 한줄씩 JSON 출력
+
+#include "preheader.h"
+
+#include "../ServerBalancer.h"
+#include <boost/make_shared.hpp>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	struct bench_server_t
+	{
+		int32_t m_server_id{0};
+		int32_t m_user_count{0};
+		BusyLevel_e::TYPE m_busy_level{BusyLevel_e::BUSY_IDLE};
+
+		int32_t balanceKeyServerId() const { return m_server_id; }
+		int32_t balanceKeyUserCount() const { return m_user_count; }
+		BusyLevel_e::TYPE busyLevel() const { return m_busy_level; }
+		void setBusyLevel(BusyLevel_e::TYPE busy_level) { m_busy_level = busy_level; }
+		string_t toString() const { return string_t(); }
+	};
+
+	typedef ServerBalancer<bench_server_t> balancer_t;
+
+	const int32_t LOOKUP_COUNT = 1000000;
+	const uint64_t REMAP_KEY_COUNT = 200000;
+
+	void registerServers(balancer_t &balancer, int32_t first_server_id, int32_t server_count)
+	{
+		for (int32_t server_id = first_server_id; server_id < first_server_id + server_count; ++server_id)
+		{
+			auto server = boost::make_shared<bench_server_t>();
+			server->m_server_id = server_id;
+			balancer.registerServer(server);
+		}
+	}
+
+	// 할당된 서버의 인원을 늘려 부하 상한에 걸려 다음 서버로 넘어가는 경우도 포함한다.
+	double lookupNs(int32_t server_count)
+	{
+		balancer_t balancer;
+		balancer.m_base_fill_user_count = LOOKUP_COUNT / server_count / 2;
+		registerServers(balancer, 1, server_count);
+
+		auto begin_time = std::chrono::steady_clock::now();
+		for (int32_t index = 0; index < LOOKUP_COUNT; ++index)
+		{
+			auto server = balancer.allocByAffinity(static_cast<uint64_t>(index % 50000));
+			if (server)
+			{
+				++server->m_user_count;
+			}
+		}
+		auto elapsed = std::chrono::steady_clock::now() - begin_time;
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / LOOKUP_COUNT;
+	}
+
+	void assignKeys(balancer_t &balancer, _out std::vector<int32_t> &server_ids)
+	{
+		server_ids.resize(REMAP_KEY_COUNT);
+		for (uint64_t key = 0; key < REMAP_KEY_COUNT; ++key)
+		{
+			server_ids[key] = balancer.allocByAffinity(key)->m_server_id;
+		}
+	}
+
+	double movedFraction(const std::vector<int32_t> &before, const std::vector<int32_t> &after)
+	{
+		uint64_t moved_count = 0;
+		for (uint64_t key = 0; key < REMAP_KEY_COUNT; ++key)
+		{
+			moved_count += (before[key] != after[key]) ? 1 : 0;
+		}
+		return static_cast<double>(moved_count) / REMAP_KEY_COUNT;
+	}
+
+	// 부하 상한에 걸리지 않게 기준인원을 크게 두고 ring 배치만으로 이동 비율을 본다.
+	void remapFraction(int32_t server_count, _out double &add_fraction, _out double &remove_fraction)
+	{
+		balancer_t balancer;
+		balancer.m_base_fill_user_count = std::numeric_limits<int32_t>::max() / 2;
+		registerServers(balancer, 1, server_count);
+
+		std::vector<int32_t> before, after;
+		assignKeys(balancer, before);
+
+		registerServers(balancer, server_count + 1, 1);
+		assignKeys(balancer, after);
+		add_fraction = movedFraction(before, after);
+
+		balancer.unregisterServer(server_count + 1);
+		balancer.unregisterServer(1);
+		assignKeys(balancer, after);
+		remove_fraction = movedFraction(before, after);
+	}
+} // namespace
+
+int main()
+{
+	const int32_t server_counts[] = {8, 64, 512};
+	for (int32_t server_count : server_counts)
+	{
+		double lookup_ns = lookupNs(server_count);
+		double add_fraction = 0.0;
+		double remove_fraction = 0.0;
+		remapFraction(server_count, add_fraction, remove_fraction);
+
+		printf("{\"bench\":\"affinity\",\"server_count\":%d,\"lookup_ns\":%.1f,\"add_remap_fraction\":%.4f,\"add_remap_ideal\":%.4f,\"remove_remap_fraction\":%.4f,\"remove_remap_ideal\":%.4f}\n",
+			   server_count, lookup_ns, add_fraction, 1.0 / (server_count + 1), remove_fraction, 1.0 / server_count);
+	}
+	return 0;
+}
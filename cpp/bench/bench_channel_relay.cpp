@@ -0,0 +1,591 @@
+//
+// loopback으로 채널 릴레이 경로를 실제 채널 세션/핸들러로 돌려 처리량과 지연을 잰다.
+// - 가짜 클라이언트 N개 -> 채널 GameSession -> 가짜 로직서버 M개 -> 채널 GameSession -> 클라이언트 왕복
+// - 채널 세션은 GameSession, 릴레이는 Session::touchHeader로 라우팅 정보를 찍고 Session::sendPacket(송신 예산, flush 타이머)으로 보낸다.
+// - 접속은 network_notify_socket_connected_4session, 종료는 Session::onClose의 노티로 network_notify_socket_closed_4session,
+//   로직서버의 세션 정보 갱신은 network_notify_user_session_info 핸들러를 MessageProcessor로 처리한다.
+// - 로직서버 배정은 ServerBalancer, 클라이언트는 일정 횟수마다 접속을 끊고 다시 맺는다.
+// - 클라이언트 요청은 클라이언트 세션이 받은 것처럼 채널 io에서 넣는다. 응답을 READ_TIMEOUT_MSEC 안에 받지 못하면
+//   (송신 예산에서 버려졌거나 끊긴 경우) 시간 초과로 세고 다시 접속한다.
+// 채널 io 스레드 수별로 한줄씩 JSON 출력, 채널 서버 코드와 네트워크 라이브러리(libGen)를 같이 빌드한다.
+
+#include "preheader.h"
+
+#include "../handlers_network_4session.h"
+#include "../SessionManager.h"
+#include "../ServerBalancer.h"
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <boost/make_shared.hpp>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	using boost::asio::ip::tcp;
+
+	const int32_t CLIENT_COUNT = 16;
+	const int32_t LOGIC_SERVER_COUNT = 4;
+	const int32_t ROUND_TRIP_PER_CLIENT = 2000;
+	const int32_t RECONNECT_INTERVAL = 250;	  ///< 클라이언트 재접속 간격(왕복 수)
+	const int32_t SESSION_INFO_INTERVAL = 16; ///< 로직서버의 세션 정보 갱신 간격(릴레이 수)
+	const int32_t READ_TIMEOUT_MSEC = 1000;
+	const int32_t SESSION_WAIT_MSEC = 1000;
+
+	// MessageProcessor와 같은 순서로 핸들러를 처리한다. 핸들러가 세션을 찾도록 헤더에 세션 id를 넣는다.
+	template <typename HANDLER, typename NET_MSG>
+	void processHandler(const NET_MSG &net_msg, uint64_t session_id)
+	{
+		auto packet = NetMsgToPacket(net_msg);
+		packet->packetHeader().setSessionId(session_id);
+		MessageProcessor<HANDLER>().process(packet);
+	}
+
+	// 클라이언트 요청/로직서버 응답으로 쓰는 메시지, 내용이 같으므로 패킷 크기가 일정하다.
+	msg_gen_network::notify_system_error makeRelayMessage()
+	{
+		msg_gen_network::notify_system_error net_msg;
+		net_msg.msgInfo.msgResult = gplat::toMsgResult(gplat::Result().setOk());
+		return net_msg;
+	}
+
+	// balancer에 등록하는 로직서버, m_balancer_mutex 잠근 상태에서만 접근
+	struct bench_logic_server_t
+	{
+		int32_t m_server_id{0};
+		int32_t m_user_count{0};
+		BusyLevel_e::TYPE m_busy_level{BusyLevel_e::BUSY_IDLE};
+
+		int32_t balanceKeyServerId() const { return m_server_id; }
+		int32_t balanceKeyUserCount() const { return m_user_count; }
+		BusyLevel_e::TYPE busyLevel() const { return m_busy_level; }
+		void setBusyLevel(BusyLevel_e::TYPE busy_level) { m_busy_level = busy_level; }
+		string_t toString() const { return string_t(); }
+	};
+
+	struct relay_counter_t
+	{
+		std::atomic<int64_t> m_relayed_count{0};
+		std::atomic<int64_t> m_connect_count{0};
+		std::atomic<int64_t> m_close_count{0};
+		std::atomic<int64_t> m_session_info_count{0};
+		std::atomic<int64_t> m_quota_reject_count{0};
+		std::atomic<int64_t> m_read_timeout_count{0};
+	};
+
+	class bench_channel_t;
+
+	// 채널 세션, 종료시 배정받은 로직서버 인원을 돌려준 후 GameSession::onClose로 넘긴다.
+	class bench_session_t
+		: public GameSession
+	{
+	public:
+		bench_session_t(bench_channel_t &channel, gplat::asio::io_context &io_context, boost::shared_ptr<tcp::socket> sock)
+			: GameSession(boost::make_shared<InstantId>(), io_context, sock, "bench.session"), m_channel(channel)
+		{
+		}
+
+		void onClose() override;
+
+	public:
+		boost::shared_ptr<bench_logic_server_t> m_bench_logic_server;
+
+	private:
+		bench_channel_t &m_channel;
+	};
+
+	// 채널 -> 로직서버 링크, 링크 세션으로 보낸 순서대로 릴레이 대상 세션 id를 쌓는다.
+	struct logic_link_t
+	{
+		boost::shared_ptr<bench_session_t> m_session;
+		std::mutex m_mutex;
+		std::deque<uint64_t> m_client_session_ids;
+	};
+
+	// 받은 요청마다 채널에 응답을 요청하고 SESSION_INFO_INTERVAL마다 세션 정보 갱신을 먼저 보낸다.
+	class fake_logic_server_t
+	{
+	public:
+		fake_logic_server_t(gplat::asio::io_context &io_context, uint16_t server_id)
+			: m_acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), m_sock(io_context), m_server_id(server_id)
+		{
+		}
+
+		void start(bench_channel_t &channel, logic_link_t &link, size_t request_bytes)
+		{
+			m_channel = &channel;
+			m_link = &link;
+			m_buffer.resize(request_bytes);
+			m_acceptor.async_accept(m_sock, [this](const boost::system::error_code &boost_error_code)
+									{
+										if (!boost_error_code)
+										{
+											read();
+										}
+									});
+		}
+
+		tcp::endpoint endpoint() const
+		{
+			return m_acceptor.local_endpoint();
+		}
+
+		void close()
+		{
+			boost::system::error_code boost_error_code;
+			m_acceptor.close(boost_error_code);
+			m_sock.close(boost_error_code);
+		}
+
+	private:
+		void read();
+
+	private:
+		tcp::acceptor m_acceptor;
+		tcp::socket m_sock;
+		uint16_t m_server_id;
+		bench_channel_t *m_channel{nullptr};
+		logic_link_t *m_link{nullptr};
+		std::vector<char> m_buffer;
+		int32_t m_relay_count{0}; ///< 로직서버 io 스레드에서만 접근
+	};
+
+	class bench_channel_t
+	{
+	public:
+		bench_channel_t(std::vector<std::unique_ptr<fake_logic_server_t>> &logic_servers)
+			: m_acceptor(m_io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+			  m_request_bytes(NetMsgToPacket(makeRelayMessage())->packetSize()), m_logic_links(logic_servers.size() + 1)
+		{
+			m_balancer.m_base_fill_user_count = CLIENT_COUNT;
+			for (size_t index = 0; index < logic_servers.size(); ++index)
+			{
+				uint16_t server_id = static_cast<uint16_t>(index + 1);
+				auto logic_server = boost::make_shared<bench_logic_server_t>();
+				logic_server->m_server_id = server_id;
+				m_balancer.registerServer(logic_server);
+
+				// 링크도 채널의 서버 세션으로 만든다.
+				auto &link = m_logic_links[server_id];
+				link.reset(new logic_link_t());
+				logic_servers[index]->start(*this, *link, m_request_bytes);
+
+				auto sock = boost::make_shared<tcp::socket>(m_io_context);
+				sock->connect(logic_servers[index]->endpoint());
+				link->m_session = boost::make_shared<bench_session_t>(*this, m_io_context, sock);
+				startSession(link->m_session, session_type_e::server);
+			}
+			accept();
+		}
+
+		~bench_channel_t()
+		{
+			stop();
+		}
+
+		void start(int32_t thread_count)
+		{
+			for (int32_t index = 0; index < thread_count; ++index)
+			{
+				m_threads.emplace_back([this]() { m_io_context.run(); });
+			}
+		}
+
+		void stop()
+		{
+			m_io_context.stop();
+			for (auto &thread : m_threads)
+			{
+				thread.join();
+			}
+			m_threads.clear();
+		}
+
+		tcp::endpoint endpoint() const
+		{
+			return m_acceptor.local_endpoint();
+		}
+
+		size_t replyBytes() const
+		{
+			return m_request_bytes;
+		}
+
+		const relay_counter_t &counter() const
+		{
+			return m_counter;
+		}
+
+		void addReadTimeout()
+		{
+			m_counter.m_read_timeout_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		/// 클라이언트 로컬 포트로 접속한 채널 세션을 찾는다. 접속 처리가 끝날 때까지 기다린다.
+		boost::shared_ptr<bench_session_t> waitSession(uint16_t client_port)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SESSION_WAIT_MSEC);
+			while (std::chrono::steady_clock::now() < deadline)
+			{
+				{
+					spin_mutex_t::scoped_lock lock(m_sessions_mutex);
+					auto it = m_sessions_by_port.find(client_port);
+					if (it != m_sessions_by_port.end())
+					{
+						auto session = it->second.lock();
+						m_sessions_by_port.erase(it);
+						return session;
+					}
+				}
+				std::this_thread::yield();
+			}
+			return nullptr;
+		}
+
+		// 클라이언트 -> 로직서버, 클라이언트 세션이 받은 요청처럼 touchHeader로 라우팅 정보를 찍고 라우팅 테이블의 로직서버로 보낸다.
+		void postRelay(boost::shared_ptr<bench_session_t> client_session)
+		{
+			boost::asio::post(m_io_context, [this, client_session]()
+							  {
+								  auto request = NetMsgToPacket(makeRelayMessage());
+								  client_session->touchHeader(request);
+
+								  uint16_t logic_server_id = SessionRoutingTable::instance().logicServerId(client_session->routingSlot());
+								  if (logic_server_id >= m_logic_links.size() || !m_logic_links[logic_server_id])
+								  {
+									  return;
+								  }
+								  auto &link = *m_logic_links[logic_server_id];
+								  std::lock_guard<std::mutex> lock(link.m_mutex);
+								  link.m_client_session_ids.push_back(client_session->sessionId());
+								  if (!link.m_session->sendPacket(request))
+								  {
+									  link.m_client_session_ids.pop_back();
+									  m_counter.m_quota_reject_count.fetch_add(1, std::memory_order_relaxed);
+									  return;
+								  }
+								  m_counter.m_relayed_count.fetch_add(1, std::memory_order_relaxed);
+							  });
+		}
+
+		// 로직서버 -> 클라이언트, 채널 세션의 송신 예산을 거친다. 버려지면 클라이언트는 시간 초과로 안다.
+		void reply(uint64_t client_session_id)
+		{
+			auto client_session = boost::static_pointer_cast<bench_session_t>(m_session_manager.getSessionById(client_session_id));
+			if (!client_session || !client_session->sendPacket(NetMsgToPacket(makeRelayMessage())))
+			{
+				m_counter.m_quota_reject_count.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			m_counter.m_relayed_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// 로직서버 -> 채널 세션 정보 갱신, 로직서버 링크 세션이 받은 노티로 핸들러를 처리한다.
+		void updateSessionInfo(uint16_t logic_server_id, uint64_t client_session_id, int32_t zone_server_id)
+		{
+			msg_gen_network::notify_user_session_info notify;
+			notify.channel_session_id = client_session_id;
+			notify.logic_server_id = logic_server_id;
+			notify.zone_server_id = zone_server_id;
+			processHandler<handler::network_notify_user_session_info>(notify, m_logic_links[logic_server_id]->m_session->sessionId());
+			m_counter.m_session_info_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// bench_session_t::onClose, Session::onClose 전에 배정받은 로직서버 인원을 돌려준다.
+		void onSessionClosed(bench_session_t &session)
+		{
+			if (!session.m_bench_logic_server)
+			{
+				return;
+			}
+			{
+				spin_mutex_t::scoped_lock lock(m_balancer_mutex);
+				--session.m_bench_logic_server->m_user_count;
+				m_balancer.updateServer(session.m_bench_logic_server->m_server_id);
+			}
+			m_counter.m_close_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+	private:
+		void accept()
+		{
+			auto sock = boost::make_shared<tcp::socket>(m_io_context);
+			m_acceptor.async_accept(*sock, [this, sock](const boost::system::error_code &boost_error_code)
+									{
+										if (boost_error_code)
+										{
+											return;
+										}
+										onClientConnected(sock);
+										accept();
+									});
+		}
+
+		void startSession(const boost::shared_ptr<bench_session_t> &session, session_type_e::type session_type)
+		{
+			m_session_manager.addSession(session);
+			gplat::Result res = session->init(&m_session_manager);
+			if (res.fail())
+			{
+				LOG_ERROR(res.toString());
+			}
+			session->setSessionType(session_type);
+			session->startSocket();
+		}
+
+		// 접속 노티 핸들러 후 로그인 처리처럼 로직서버를 배정한다.
+		void onClientConnected(boost::shared_ptr<tcp::socket> sock)
+		{
+			boost::system::error_code boost_error_code;
+			uint16_t client_port = sock->remote_endpoint(boost_error_code).port();
+
+			auto session = boost::make_shared<bench_session_t>(*this, m_io_context, sock);
+			startSession(session, session_type_e::user);
+
+			msg_gen_network::notify_socket_connected notify;
+			notify.session_id = session->sessionId();
+			processHandler<handler::network_notify_socket_connected_4session>(notify, session->sessionId());
+
+			{
+				spin_mutex_t::scoped_lock lock(m_balancer_mutex);
+				session->m_bench_logic_server = m_balancer.alloc();
+				if (session->m_bench_logic_server)
+				{
+					++session->m_bench_logic_server->m_user_count;
+					m_balancer.updateServer(session->m_bench_logic_server->m_server_id);
+				}
+			}
+			if (!session->m_bench_logic_server)
+			{
+				sock->close(boost_error_code);
+				return;
+			}
+			session->m_logic_server_id = static_cast<uint16_t>(session->m_bench_logic_server->m_server_id);
+			session->syncRouting();
+			m_counter.m_connect_count.fetch_add(1, std::memory_order_relaxed);
+
+			spin_mutex_t::scoped_lock lock(m_sessions_mutex);
+			m_sessions_by_port[client_port] = session;
+		}
+
+	private:
+		gplat::asio::io_context m_io_context;
+		tcp::acceptor m_acceptor;
+		std::vector<std::thread> m_threads;
+		size_t m_request_bytes;
+		std::vector<std::unique_ptr<logic_link_t>> m_logic_links; ///< logic_server_id -> 링크
+
+		SessionManager m_session_manager;
+		ServerBalancer<bench_logic_server_t> m_balancer;
+		spin_mutex_t m_balancer_mutex;
+
+		spin_mutex_t m_sessions_mutex;
+		std::unordered_map<uint16_t, boost::weak_ptr<bench_session_t>> m_sessions_by_port; ///< 클라이언트가 찾아가기 전까지
+
+		relay_counter_t m_counter;
+	};
+
+	void bench_session_t::onClose()
+	{
+		m_channel.onSessionClosed(*this);
+		GameSession::onClose();
+	}
+
+	void fake_logic_server_t::read()
+	{
+		boost::asio::async_read(m_sock, boost::asio::buffer(m_buffer), [this](const boost::system::error_code &boost_error_code, size_t)
+								{
+									if (boost_error_code)
+									{
+										return;
+									}
+
+									uint64_t client_session_id = 0;
+									{
+										std::lock_guard<std::mutex> lock(m_link->m_mutex);
+										if (!m_link->m_client_session_ids.empty())
+										{
+											client_session_id = m_link->m_client_session_ids.front();
+											m_link->m_client_session_ids.pop_front();
+										}
+									}
+									if (0 != client_session_id)
+									{
+										if (0 == ++m_relay_count % SESSION_INFO_INTERVAL)
+										{
+											m_channel->updateSessionInfo(m_server_id, client_session_id, m_server_id * 1000 + m_relay_count % 1000);
+										}
+										m_channel->reply(client_session_id);
+									}
+									read();
+								});
+	}
+
+	// 제한 시간 안에 size 만큼 읽으면 true, 시간이 지나면 읽기를 취소한다.
+	bool readWithTimeout(gplat::asio::io_context &io_context, tcp::socket &sock, void *buffer, size_t size)
+	{
+		bool completed = false;
+		boost::system::error_code read_error_code;
+		boost::asio::async_read(sock, boost::asio::buffer(buffer, size), [&completed, &read_error_code](const boost::system::error_code &boost_error_code, size_t)
+								{
+									completed = true;
+									read_error_code = boost_error_code;
+								});
+		io_context.restart();
+		io_context.run_for(std::chrono::milliseconds(READ_TIMEOUT_MSEC));
+		if (!completed)
+		{
+			boost::system::error_code boost_error_code;
+			sock.cancel(boost_error_code);
+			io_context.restart();
+			io_context.run();
+			return false;
+		}
+		return !read_error_code;
+	}
+
+	// 왕복마다 응답을 기다리는 클라이언트, RECONNECT_INTERVAL마다 또는 응답 시간 초과시 다시 접속한다.
+	void runClient(bench_channel_t &channel, _out std::vector<double> &out_latency_usec)
+	{
+		gplat::asio::io_context io_context;
+		std::unique_ptr<tcp::socket> sock;
+		boost::shared_ptr<bench_session_t> session;
+		out_latency_usec.reserve(ROUND_TRIP_PER_CLIENT);
+
+		std::vector<char> reply(channel.replyBytes());
+		bool reconnect = true;
+		for (int32_t index = 0; index < ROUND_TRIP_PER_CLIENT; ++index)
+		{
+			if (reconnect || 0 == index % RECONNECT_INTERVAL)
+			{
+				boost::system::error_code boost_error_code;
+				if (sock)
+				{
+					sock->close(boost_error_code);
+				}
+				sock.reset(new tcp::socket(io_context));
+				sock->connect(channel.endpoint());
+				session = channel.waitSession(sock->local_endpoint(boost_error_code).port());
+				reconnect = false;
+			}
+			if (!session)
+			{
+				reconnect = true;
+				continue;
+			}
+
+			auto begin_time = std::chrono::steady_clock::now();
+			channel.postRelay(session);
+			if (!readWithTimeout(io_context, *sock, reply.data(), reply.size()))
+			{
+				channel.addReadTimeout();
+				reconnect = true;
+				continue;
+			}
+			auto elapsed = std::chrono::steady_clock::now() - begin_time;
+			out_latency_usec.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / 1000.0);
+		}
+		boost::system::error_code boost_error_code;
+		sock->close(boost_error_code);
+	}
+
+	double percentileUsec(const std::vector<double> &sorted_samples, double percentile)
+	{
+		if (sorted_samples.empty())
+		{
+			return 0.0;
+		}
+		size_t index = static_cast<size_t>(percentile * (sorted_samples.size() - 1));
+		return sorted_samples[index];
+	}
+
+	void measure(int32_t channel_thread_count)
+	{
+		gplat::asio::io_context logic_io_context;
+		std::vector<std::unique_ptr<fake_logic_server_t>> logic_servers;
+		for (int32_t index = 0; index < LOGIC_SERVER_COUNT; ++index)
+		{
+			logic_servers.emplace_back(new fake_logic_server_t(logic_io_context, static_cast<uint16_t>(index + 1)));
+		}
+		auto logic_work_guard = boost::asio::make_work_guard(logic_io_context);
+		std::thread logic_thread([&logic_io_context]() { logic_io_context.run(); });
+
+		std::vector<std::vector<double>> latencies(CLIENT_COUNT);
+		std::chrono::steady_clock::duration elapsed;
+		relay_counter_t counter_snapshot;
+		{
+			bench_channel_t channel(logic_servers);
+			channel.start(channel_thread_count);
+
+			auto begin_time = std::chrono::steady_clock::now();
+			std::vector<std::thread> client_threads;
+			for (int32_t index = 0; index < CLIENT_COUNT; ++index)
+			{
+				client_threads.emplace_back([&channel, &latencies, index]() { runClient(channel, latencies[index]); });
+			}
+			for (auto &thread : client_threads)
+			{
+				thread.join();
+			}
+			elapsed = std::chrono::steady_clock::now() - begin_time;
+
+			// 마지막 종료 처리를 기다린다.
+			for (int32_t wait_count = 0; wait_count < 100 && channel.counter().m_close_count.load() < channel.counter().m_connect_count.load(); ++wait_count)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+
+			const relay_counter_t &counter = channel.counter();
+			counter_snapshot.m_relayed_count = counter.m_relayed_count.load();
+			counter_snapshot.m_connect_count = counter.m_connect_count.load();
+			counter_snapshot.m_close_count = counter.m_close_count.load();
+			counter_snapshot.m_session_info_count = counter.m_session_info_count.load();
+			counter_snapshot.m_quota_reject_count = counter.m_quota_reject_count.load();
+			counter_snapshot.m_read_timeout_count = counter.m_read_timeout_count.load();
+			channel.stop();
+		}
+
+		for (auto &logic_server : logic_servers)
+		{
+			logic_server->close();
+		}
+		logic_work_guard.reset();
+		logic_io_context.stop();
+		logic_thread.join();
+
+		std::vector<double> samples;
+		for (const auto &client_latencies : latencies)
+		{
+			samples.insert(samples.end(), client_latencies.begin(), client_latencies.end());
+		}
+		std::sort(samples.begin(), samples.end());
+
+		double elapsed_sec = std::chrono::duration<double>(elapsed).count();
+		int64_t relayed_count = counter_snapshot.m_relayed_count.load() + counter_snapshot.m_session_info_count.load();
+		printf("{\"bench\":\"channel_relay\",\"channel_threads\":%d,\"hardware_threads\":%u,\"clients\":%d,\"logic_servers\":%d,\"round_trips\":%zu,"
+			   "\"round_trips_per_sec\":%.0f,\"relayed_msgs_per_sec\":%.0f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,"
+			   "\"connects\":%lld,\"closes\":%lld,\"session_info_updates\":%lld,\"quota_rejects\":%lld,\"read_timeouts\":%lld}\n",
+			   channel_thread_count, std::thread::hardware_concurrency(), CLIENT_COUNT, LOGIC_SERVER_COUNT, samples.size(),
+			   samples.size() / elapsed_sec, relayed_count / elapsed_sec,
+			   percentileUsec(samples, 0.50), percentileUsec(samples, 0.99), percentileUsec(samples, 0.999),
+			   static_cast<long long>(counter_snapshot.m_connect_count.load()), static_cast<long long>(counter_snapshot.m_close_count.load()),
+			   static_cast<long long>(counter_snapshot.m_session_info_count.load()), static_cast<long long>(counter_snapshot.m_quota_reject_count.load()),
+			   static_cast<long long>(counter_snapshot.m_read_timeout_count.load()));
+	}
+} // namespace
+
+int main()
+{
+	const int32_t channel_thread_counts[] = {1, 2, 4, 8};
+	for (int32_t channel_thread_count : channel_thread_counts)
+	{
+		measure(channel_thread_count);
+	}
+	return 0;
+}
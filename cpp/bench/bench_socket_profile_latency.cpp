@@ -0,0 +1,193 @@
+//
+// loopback 요청/응답 왕복 지연을 socket profile별로 잰다.
+// 요청은 헤더와 본문을 나눠 쓰는(write-write-read) 형태라 Nagle/지연 ack 영향이 드러난다.
+// profile별로 한줄씩 JSON 출력
+
+#include "preheader.h"
+
+#include "../SocketProfile.h"
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using boost::asio::ip::tcp;
+
+	const int32_t ROUND_TRIP_COUNT = 300;
+	const size_t HEADER_SIZE = 8;
+	const size_t BODY_SIZE = 56;
+	const size_t MESSAGE_SIZE = HEADER_SIZE + BODY_SIZE;
+
+	struct bench_profile_t
+	{
+		const char *m_name;
+		socket_profile_t m_profile;
+	};
+
+	// 받은 만큼 그대로 돌려준다.
+	class echo_session_t
+		: public std::enable_shared_from_this<echo_session_t>
+	{
+	public:
+		echo_session_t(tcp::socket sock, const socket_profile_t &profile)
+			: m_sock(std::move(sock)), m_profile(profile)
+		{
+		}
+
+		void start()
+		{
+			SocketProfileRegistry::apply(m_sock, m_profile);
+			read();
+		}
+
+	private:
+		void read()
+		{
+			auto self = shared_from_this();
+			boost::asio::async_read(m_sock, boost::asio::buffer(m_buffer),
+									[self](const boost::system::error_code &boost_error_code, size_t)
+									{
+										if (boost_error_code)
+										{
+											return;
+										}
+										if (self->m_profile.m_quick_ack)
+										{
+											SocketProfileRegistry::rearmQuickAck(self->m_sock);
+										}
+										self->write();
+									});
+		}
+
+		void write()
+		{
+			auto self = shared_from_this();
+			boost::asio::async_write(m_sock, boost::asio::buffer(m_buffer),
+									 [self](const boost::system::error_code &boost_error_code, size_t)
+									 {
+										 if (!boost_error_code)
+										 {
+											 self->read();
+										 }
+									 });
+		}
+
+	private:
+		tcp::socket m_sock;
+		socket_profile_t m_profile;
+		char m_buffer[MESSAGE_SIZE];
+	};
+
+	double percentileUsec(std::vector<double> &samples, double percentile)
+	{
+		std::sort(samples.begin(), samples.end());
+		size_t index = static_cast<size_t>(percentile * (samples.size() - 1));
+		return samples[index];
+	}
+
+	void measure(const bench_profile_t &bench_profile)
+	{
+		// 서버쪽 io_context, run_to_completion이면 Session처럼 busy poll runner의 io_context에서 받고 세션을 붙인다.
+		BusyPollRunner busy_poll_runner;
+		gplat::asio::io_context shared_io_context;
+		gplat::asio::io_context &server_io_context = bench_profile.m_profile.m_run_to_completion ? busy_poll_runner.ioContext() : shared_io_context;
+
+		tcp::acceptor acceptor(server_io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+		acceptor.async_accept([&bench_profile, &busy_poll_runner, &server_io_context](const boost::system::error_code &boost_error_code, tcp::socket sock)
+							  {
+								  if (!boost_error_code)
+								  {
+									  if (bench_profile.m_profile.m_run_to_completion)
+									  {
+										  busy_poll_runner.attach(server_io_context);
+									  }
+									  std::make_shared<echo_session_t>(std::move(sock), bench_profile.m_profile)->start();
+								  }
+							  });
+
+		std::thread server_thread;
+		auto work_guard = boost::asio::make_work_guard(shared_io_context);
+		if (bench_profile.m_profile.m_run_to_completion)
+		{
+			busy_poll_runner.start(1);
+		}
+		else
+		{
+			server_thread = std::thread([&shared_io_context]() { shared_io_context.run(); });
+		}
+
+		gplat::asio::io_context client_io_context;
+		tcp::socket client(client_io_context);
+		client.connect(acceptor.local_endpoint());
+		SocketProfileRegistry::apply(client, bench_profile.m_profile);
+
+		char message[MESSAGE_SIZE] = {};
+		char reply[MESSAGE_SIZE];
+		std::vector<double> samples;
+		samples.reserve(ROUND_TRIP_COUNT);
+		for (int32_t index = 0; index < ROUND_TRIP_COUNT; ++index)
+		{
+			auto begin_time = std::chrono::steady_clock::now();
+			{
+				cork_scope_t cork_scope(bench_profile.m_profile.m_cork ? &client : nullptr);
+				boost::asio::write(client, boost::asio::buffer(message, HEADER_SIZE));
+				boost::asio::write(client, boost::asio::buffer(message + HEADER_SIZE, BODY_SIZE));
+			}
+			boost::asio::read(client, boost::asio::buffer(reply));
+			if (bench_profile.m_profile.m_quick_ack)
+			{
+				SocketProfileRegistry::rearmQuickAck(client);
+			}
+			auto elapsed = std::chrono::steady_clock::now() - begin_time;
+			samples.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / 1000.0);
+		}
+
+		boost::system::error_code boost_error_code;
+		client.close(boost_error_code);
+		busy_poll_runner.stop();
+		work_guard.reset();
+		shared_io_context.stop();
+		if (server_thread.joinable())
+		{
+			server_thread.join();
+		}
+
+		double p50 = percentileUsec(samples, 0.50);
+		double p99 = percentileUsec(samples, 0.99);
+		printf("{\"bench\":\"socket_profile_latency\",\"profile\":\"%s\",\"round_trips\":%d,\"p50_us\":%.1f,\"p99_us\":%.1f}\n",
+			   bench_profile.m_name, ROUND_TRIP_COUNT, p50, p99);
+	}
+} // namespace
+
+int main()
+{
+	std::vector<bench_profile_t> bench_profiles(5);
+
+	bench_profiles[0].m_name = "nagle";
+	bench_profiles[0].m_profile.m_no_delay = false;
+
+	bench_profiles[1].m_name = "no_delay";
+
+	bench_profiles[2].m_name = "no_delay_quick_ack";
+	bench_profiles[2].m_profile.m_quick_ack = true;
+
+	bench_profiles[3].m_name = "cork_batch";
+	bench_profiles[3].m_profile.m_no_delay = false;
+	bench_profiles[3].m_profile.m_cork = true;
+
+	bench_profiles[4].m_name = "busy_poll";
+	bench_profiles[4].m_profile.m_quick_ack = true;
+	bench_profiles[4].m_profile.m_busy_poll_usec = 50;
+	bench_profiles[4].m_profile.m_run_to_completion = true;
+
+	for (const auto &bench_profile : bench_profiles)
+	{
+		measure(bench_profile);
+	}
+	return 0;
+}
@@ -6,6 +6,9 @@
 #include "GameUser.h"
 #include "GameSessionHandler.h"
 #include "GameSession.h"
+#include "LogicServerBalancer.h"
+#include "LogicServerFailover.h"
+#include "SessionRoutingFilter.h"
 #include <result_code_types.h>
 
 namespace handler
@@ -59,6 +62,9 @@ namespace handler
 				//유저에게 알림 제거, 사용자가 다른 방식으로 극복이 가능함 : by joygram 2020/11/18
 				//notifyServerShutdownToUsers(server_id);
 
+				//끊어진 로직서버의 사용자를 살아있는 로직서버로 일괄 재배치
+				rebindUsersToAliveServers(server_id);
+
 			}
 			else if (session_type_e::user == session_type)
 			{
@@ -78,35 +84,98 @@ namespace handler
 			return m_result.setOk();
 		}
 
+		// 해당 로직서버에 묶인 사용자 세션을 라우팅 테이블 일괄 검색으로 모은다.
+		// 검색 결과는 slot 기준이므로 세션을 다시 찾아 실제로 묶인 서버를 확인한다.
+		void collectUserSessions(int32_t in_server_id, _out std::vector<boost::shared_ptr<GameSession>> &out_sessions)
+		{
+			out_sessions.clear();
+
+			SessionSlotBitmap slot_bitmap;
+			SessionRoutingFilter()
+				.whereLogicServerId(static_cast<uint16_t>(in_server_id))
+				.whereSessionType(static_cast<uint8_t>(session_type_e::user))
+				.scan(SessionRoutingTable::instance(), slot_bitmap);
+
+			slot_bitmap.forEach([&](uint32_t slot)
+								{
+									auto game_session = boost::static_pointer_cast<GameSession>(sessionManager()->getSessionById(SessionRoutingTable::instance().sessionId(slot)));
+									if (!game_session || !game_session->gameUser())
+									{
+										return;
+									}
+									auto user_logic_server = game_session->gameUser()->logicServer();
+									if (user_logic_server && in_server_id == user_logic_server->m_server_info.serverId)
+									{
+										out_sessions.push_back(game_session);
+									}
+								});
+		}
+
+		void rebindUsersToAliveServers(int32_t in_server_id)
+		{
+			std::vector<boost::shared_ptr<GameSession>> game_sessions;
+			collectUserSessions(in_server_id, game_sessions);
+
+			std::vector<uint64_t> session_ids;
+			session_ids.reserve(game_sessions.size());
+			for (const auto &game_session : game_sessions)
+			{
+				session_ids.push_back(game_session->sessionId());
+			}
+
+			// 재등록은 응답을 기다리지 않고 대상 로직서버별로 한번에 묶어 보낸다.
+			LogicServerFailover<LogicServer> failover;
+			failover.setBatchSize(static_cast<int32_t>(session_ids.size()));
+			failover.rebind(in_server_id, logicServerBalancer(), session_ids,
+							[this](boost::shared_ptr<LogicServer> logic_server, const std::vector<uint64_t> &batch)
+							{
+								msg_gen_manage::req_client_register_batch req;
+								req.channelSessionIds.reserve(batch.size());
+								req.authIds.reserve(batch.size());
+								for (auto session_id : batch)
+								{
+									auto game_session = boost::static_pointer_cast<GameSession>(sessionManager()->getSessionById(session_id));
+									if (!game_session || !game_session->gameUser())
+									{
+										continue;
+									}
+									auto game_user = game_session->gameUser();
+									game_user->m_logic_server = logic_server;
+									game_session->m_logic_server_id = static_cast<uint16_t>(logic_server->m_server_info.serverId);
+									game_session->syncRouting();
+
+									req.channelSessionIds.push_back(session_id);
+									req.authIds.push_back(game_user->m_account_db_id);
+								}
+								if (!req.channelSessionIds.empty())
+								{
+									logic_server->send(req);
+								}
+							});
+		}
+
 		void notifyServerShutdownToUsers(int32_t in_server_id)
 		{
 			//로직서버와의 연결이 단절 되었음. 사용자에게 알림 
-			auto session_list = gameServer()->sessionManager()->toVector();
-			for (auto session : session_list) //session broadcast & logic server reset
+			std::vector<boost::shared_ptr<GameSession>> game_sessions;
+			collectUserSessions(in_server_id, game_sessions);
+			for (const auto &game_session : game_sessions) //session broadcast & logic server reset
 			{
-				auto game_session = boost::static_pointer_cast<GameSession>(session);
 				auto game_user = game_session->gameUser();
-				if (!game_user)
-				{
-					continue;
-				}
-				auto user_logic_server = game_user->logicServer();
-				if (!user_logic_server)
-				{
-					continue;
-				}
-				if (in_server_id == user_logic_server->m_server_info.serverId)
-				{
-					game_user->m_logic_server.reset();
+				game_user->m_logic_server.reset();
 
-					gplat::Result notify_result;
-					notify_result.setFail(result::code_e::GPLAT_LOGIC_SERVER_DISCONNECTED, sformat("logic server:{0} shutdown", in_server_id));
+				gplat::Result notify_result;
+				notify_result.setFail(result::code_e::GPLAT_LOGIC_SERVER_DISCONNECTED, sformat("logic server:{0} shutdown", in_server_id));
 
-					//로직서버 해제 되었음. - 클라이언트는 필요시 재연결이 가능하게 변경되었으므로 별도 알림을 수행하지 않고 로그만 남기도록 변경 by joygram 2020/11/18 
-					msg_gen_network::notify_system_error notify;
-					notify.msgInfo.msgResult = gplat::toMsgResult(notify_result);
-					game_user->sendToUser(notify);
-				}
+				//로직서버 해제 되었음. - 클라이언트는 필요시 재연결이 가능하게 변경되었으므로 별도 알림을 수행하지 않고 로그만 남기도록 변경 by joygram 2020/11/18 
+				msg_gen_network::notify_system_error notify;
+				notify.msgInfo.msgResult = gplat::toMsgResult(notify_result);
+				// 전체 사용자 대상이므로 밀려있는 세션에는 서버별 최신 알림 하나만 남긴다.
+				game_session->sendWithQuota(send_priority_e::low, static_cast<uint64_t>(in_server_id),
+											[game_user, notify]()
+											{
+												game_user->sendToUser(notify);
+											});
 			}
 		}
 
@@ -129,6 +198,9 @@ namespace handler
 			auto notify = PacketToNetMsg<handle_message_t>(m_packet);
 			LOG_INFO("{}", NetMsgToStr(*notify));
 
+			// 로직서버 세션 메시지이므로 장애 재배치용 balancer에 등록/혼잡도를 맞춘다.
+			syncLogicServerBalancer(m_logic_server);
+
 			boost::shared_ptr<GameSession> client_session;
 
 			boost::shared_ptr<User> game_user;
@@ -144,6 +216,7 @@ namespace handler
 			client_session->m_community_id = notify->community_id;
 			client_session->m_guild_db_id = notify->guild_db_id;
 			client_session->m_user_db_id = notify->user_db_id;
+			client_session->syncRouting();
 
 			LOG_INFO("client session info updated");
 			return m_result.setOk();
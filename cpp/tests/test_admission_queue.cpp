@@ -0,0 +1,76 @@
+//
+// 입장 요청(바로 입장/대기표), 대기표 순서대로 입장, 취소된 대기표 건너뛰기, 허용 속도와 BUSY_WARN 미만에서 허용량이 0이 되는지 확인한다.
+
+#include "preheader.h"
+
+#include "../AdmissionQueue.h"
+#include <cassert>
+#include <cstdio>
+
+int main()
+{
+	AdmissionQueue admission_queue(16);
+	admission_queue.setMaxAdmitPerSec(10.0f);
+
+	// 대기자가 없고 IDLE이면 바로 입장, WARN이면 대기표
+	uint64_t ticket = 0;
+	assert(admission_result_e::admitted == admission_queue.request(100, BusyLevel_e::BUSY_IDLE, ticket));
+	assert(AdmissionQueue::INVALID_TICKET == ticket);
+
+	std::vector<uint64_t> tickets;
+	for (uint64_t session_id = 1; session_id <= 6; ++session_id)
+	{
+		BusyLevel_e::TYPE busy_level = (1 == session_id) ? BusyLevel_e::BUSY_WARN : BusyLevel_e::BUSY_IDLE;
+		assert(admission_result_e::queued == admission_queue.request(session_id, busy_level, ticket));
+		tickets.push_back(ticket);
+	}
+	// 대기자가 있으면 IDLE이어도 줄을 선다.
+	assert(6 == admission_queue.waitingCount());
+	assert(6 == admission_queue.position(tickets[5]));
+
+	// 취소하면 뒤 순번이 당겨진다.
+	assert(admission_queue.cancel(tickets[1]));
+	assert(!admission_queue.cancel(tickets[1]));
+	assert(5 == admission_queue.waitingCount());
+	assert(2 == admission_queue.position(tickets[2]));
+	assert(5 == admission_queue.position(tickets[5]));
+
+	// 입장제한(BUSY_WARN 미만)에서는 시간이 지나도 허용하지 않고 허용량도 0
+	std::vector<uint64_t> admitted;
+	assert(0 == admission_queue.drain(BusyLevel_e::BUSY_ERROR, 0.0f, 100, 10.0f, admitted));
+	assert(0.0f == admission_queue.admitCredit());
+
+	// 부하가 fatal 기준이면 허용 속도 0, 그 전에 쌓아둔 허용량도 버린다.
+	assert(0 == admission_queue.drain(BusyLevel_e::BUSY_WARN, 0.0f, 100, 0.05f, admitted));
+	assert(0.0f < admission_queue.admitCredit());
+	assert(0 == admission_queue.drain(BusyLevel_e::BUSY_WARN, 1.0f, 100, 0.05f, admitted));
+	assert(0.0f == admission_queue.admitCredit());
+
+	// 초당 10명, 0.25초면 2명. 대기표 순서대로, 취소된 대기표는 건너뛴다.
+	assert(2 == admission_queue.drain(BusyLevel_e::BUSY_WARN, 0.0f, 100, 0.25f, admitted));
+	assert((std::vector<uint64_t>{1, 3}) == admitted);
+	assert(1 == admission_queue.position(tickets[3]));
+
+	// 부하 절반이면 초당 5명
+	assert(1 == admission_queue.drain(BusyLevel_e::BUSY_WARN, 0.5f, 100, 0.2f, admitted));
+	assert((std::vector<uint64_t>{4}) == admitted);
+
+	// 게임서버 여유 인원을 넘지 않는다.
+	assert(1 == admission_queue.drain(BusyLevel_e::BUSY_IDLE, 0.0f, 1, 1.0f, admitted));
+	assert((std::vector<uint64_t>{5}) == admitted);
+	assert(1 == admission_queue.drain(BusyLevel_e::BUSY_IDLE, 0.0f, 100, 0.1f, admitted));
+	assert((std::vector<uint64_t>{6}) == admitted);
+	assert(0 == admission_queue.waitingCount());
+
+	// 대기열이 비면 다시 바로 입장
+	assert(admission_result_e::admitted == admission_queue.request(200, BusyLevel_e::BUSY_IDLE, ticket));
+
+	// 가득 차면 거절
+	AdmissionQueue small_queue(2);
+	assert(admission_result_e::queued == small_queue.request(1, BusyLevel_e::BUSY_WARN, ticket));
+	assert(admission_result_e::queued == small_queue.request(2, BusyLevel_e::BUSY_WARN, ticket));
+	assert(admission_result_e::rejected == small_queue.request(3, BusyLevel_e::BUSY_WARN, ticket));
+
+	printf("{\"test\":\"admission_queue\",\"result\":\"ok\"}\n");
+	return 0;
+}
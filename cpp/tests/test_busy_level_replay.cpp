@@ -0,0 +1,103 @@
+//
+// 기록된 부하 샘플을 재생하여 단계 떨림 방지(dwell, 전환 간격, 단계별 복구) 전후 전환 횟수를 비교한다.
+// 재생 시각은 0초부터 시작하므로 BusyLevel 생성 시각보다 이르다.
+
+#include "preheader.h"
+
+#include "../BusyLevel.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+	const int32_t SAMPLE_COUNT = 6000;
+	const double SAMPLE_INTERVAL_SEC = 0.1;
+	const float MIN_DWELL_SEC = 5.0f;
+	const float MIN_TRANSITION_INTERVAL_SEC = 2.0f;
+
+	// 임계값 근처를 오가는 부하, 항상 같은 값이 나오도록 고정 seed LCG 사용
+	std::vector<float> makeTrace()
+	{
+		std::vector<float> trace;
+		uint32_t seed = 12345;
+		for (int32_t index = 0; index < SAMPLE_COUNT; ++index)
+		{
+			seed = seed * 1103515245u + 12345u;
+			float noise = (static_cast<float>((seed >> 16) & 0x7FFF) / 32767.0f - 0.5f) * 30.0f;
+			float wave = 25.0f * static_cast<float>(std::sin(2.0 * 3.14159265358979 * index * SAMPLE_INTERVAL_SEC / 120.0));
+			trace.push_back(std::max(0.0f, 65.0f + wave + noise));
+		}
+		return trace;
+	}
+
+	BusyLevelParam makeParam(bool use_transition)
+	{
+		BusyLevelParam param;
+		param.m_sampleCount = 5;
+		param.m_useLog = false;
+		param.m_busyFatal = 100.0f;
+		param.m_busyError = 90.0f;
+		param.m_busyWarn = 80.0f;
+		param.m_busyIdle = 70.0f;
+		param.m_busyFatalToIdle = 85.0f;
+		param.m_busyErrorToIdle = 75.0f;
+		param.m_busyWarnToIdle = 65.0f;
+		if (use_transition)
+		{
+			param.m_minDwell = MIN_DWELL_SEC;
+			param.m_minTransitionInterval = MIN_TRANSITION_INTERVAL_SEC;
+			param.m_stepRecovery = true;
+		}
+		return param;
+	}
+
+	struct replay_result_t
+	{
+		int32_t m_transition_count{0};
+		double m_min_gap_sec{1e9}; ///< FATAL 진입을 제외한 전환 간 최소 간격
+	};
+
+	replay_result_t replay(const std::vector<float> &trace, bool use_transition)
+	{
+		BusyLevel busy_level;
+		busy_level.setup(makeParam(use_transition));
+
+		replay_result_t result;
+		double last_transition_sec = 0.0;
+		for (int32_t index = 0; index < static_cast<int32_t>(trace.size()); ++index)
+		{
+			double now_sec = index * SAMPLE_INTERVAL_SEC;
+			BusyLevel::timePoint_t now{boost::chrono::duration<double>(now_sec)};
+			if (busy_level.decideAt(trace[index], "replay", 0, now))
+			{
+				if (BusyLevel_e::BUSY_FATAL != busy_level.currentBusyLevel())
+				{
+					result.m_min_gap_sec = std::min(result.m_min_gap_sec, now_sec - last_transition_sec);
+				}
+				last_transition_sec = now_sec;
+			}
+		}
+		result.m_transition_count = busy_level.transitionCount();
+		return result;
+	}
+} // namespace
+
+int main()
+{
+	std::vector<float> trace = makeTrace();
+
+	replay_result_t baseline = replay(trace, false);
+	replay_result_t damped = replay(trace, true);
+
+	// 과거 시각으로 재생해도 단계 전환이 일어나야 한다.
+	assert(0 < baseline.m_transition_count);
+	assert(0 < damped.m_transition_count);
+	assert(damped.m_transition_count < baseline.m_transition_count);
+	assert(damped.m_min_gap_sec + 1e-6 >= MIN_TRANSITION_INTERVAL_SEC);
+
+	printf("{\"test\":\"busy_level_replay\",\"sample_count\":%d,\"baseline_transition_count\":%d,\"damped_transition_count\":%d,\"damped_min_gap_sec\":%.1f}\n",
+		   SAMPLE_COUNT, baseline.m_transition_count, damped.m_transition_count, damped.m_min_gap_sec);
+	return 0;
+}
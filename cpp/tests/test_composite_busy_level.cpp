@@ -0,0 +1,138 @@
+//
+// 자원별 busy level을 WORST/WEIGHTED로 합친 단계와 원인 자원(responsibleResource), BusyResourceSampler의 자원 샘플을 확인한다.
+
+#include "preheader.h"
+
+#include "../CompositeBusyLevel.h"
+#include "../BusyResourceSampler.h"
+#include <cassert>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// 1000 초과 WARN, 4000 초과 ERROR, 8000 초과 FATAL, 800 이하이면 IDLE로 복구
+	BusyLevelParam makeParam()
+	{
+		BusyLevelParam busy_level_param;
+		busy_level_param.m_sampleCount = 1;
+		busy_level_param.m_busyFatal = 10000.0f;
+		busy_level_param.m_busyError = 8000.0f;
+		busy_level_param.m_busyWarn = 4000.0f;
+		busy_level_param.m_busyIdle = 1000.0f;
+		busy_level_param.m_busyFatalToIdle = 800.0f;
+		busy_level_param.m_busyErrorToIdle = 800.0f;
+		busy_level_param.m_busyWarnToIdle = 800.0f;
+		busy_level_param.m_useLog = false;
+		return busy_level_param;
+	}
+} // namespace
+
+int main()
+{
+	// WORST : 가장 심각한 자원, 설정하지 않은 자원은 샘플해도 무시
+	{
+		CompositeBusyLevel composite_busy_level;
+		composite_busy_level.setup(busy_resource_e::RSS, makeParam());
+		composite_busy_level.setup(busy_resource_e::TICK_OVERRUN, makeParam());
+
+		composite_busy_level.sample(busy_resource_e::RSS, 2000.0f);
+		assert(BusyLevel_e::BUSY_WARN == composite_busy_level.currentBusyLevel());
+		assert(busy_resource_e::RSS == composite_busy_level.responsibleResource());
+
+		assert(composite_busy_level.sample(busy_resource_e::TICK_OVERRUN, 6000.0f));
+		assert(BusyLevel_e::BUSY_ERROR == composite_busy_level.currentBusyLevel());
+		assert(busy_resource_e::TICK_OVERRUN == composite_busy_level.responsibleResource());
+
+		assert(!composite_busy_level.sample(busy_resource_e::HANDLER_QUEUE_DEPTH, 9000.0f));
+		assert(BusyLevel_e::BUSY_ERROR == composite_busy_level.currentBusyLevel());
+
+		composite_busy_level.sample(busy_resource_e::TICK_OVERRUN, 500.0f);
+		assert(BusyLevel_e::BUSY_WARN == composite_busy_level.currentBusyLevel());
+		assert(busy_resource_e::RSS == composite_busy_level.responsibleResource());
+	}
+
+	// WEIGHTED : 심각도(IDLE과의 단계 차이)를 가중 평균, 원인은 기여가 가장 큰 자원
+	{
+		CompositeBusyLevel composite_busy_level(CompositeBusyLevel::combine_method_e::WEIGHTED);
+		composite_busy_level.setup(busy_resource_e::RSS, makeParam(), 1.0f);
+		composite_busy_level.setup(busy_resource_e::SEND_BACKLOG, makeParam(), 2.0f);
+
+		// FATAL(3) * 1 + IDLE(0) * 2 -> 1 : WARN
+		composite_busy_level.sample(busy_resource_e::RSS, 9000.0f);
+		composite_busy_level.sample(busy_resource_e::SEND_BACKLOG, 500.0f);
+		assert(BusyLevel_e::BUSY_WARN == composite_busy_level.currentBusyLevel());
+		assert(busy_resource_e::RSS == composite_busy_level.responsibleResource());
+
+		// FATAL(3) * 1 + ERROR(2) * 2 -> 2.33 : ERROR, 기여는 송신 대기가 더 크다.
+		composite_busy_level.sample(busy_resource_e::SEND_BACKLOG, 6000.0f);
+		assert(BusyLevel_e::BUSY_ERROR == composite_busy_level.currentBusyLevel());
+		assert(busy_resource_e::SEND_BACKLOG == composite_busy_level.responsibleResource());
+
+		// 같은 값을 WORST로 보면 FATAL
+		composite_busy_level.setCombineMethod(CompositeBusyLevel::combine_method_e::WORST);
+		composite_busy_level.sample(busy_resource_e::RSS, 9000.0f);
+		assert(BusyLevel_e::BUSY_FATAL == composite_busy_level.currentBusyLevel());
+		assert(busy_resource_e::RSS == composite_busy_level.responsibleResource());
+	}
+
+	// sampler : 핸들러 대기 수, 틱 초과, accept 대기 수를 한번에 샘플한다.
+	int32_t accept_backlog = 0;
+	{
+		CompositeBusyLevel composite_busy_level;
+		composite_busy_level.setup(busy_resource_e::HANDLER_QUEUE_DEPTH, makeParam());
+		composite_busy_level.setup(busy_resource_e::TICK_OVERRUN, makeParam());
+
+		BusyResourceSampler sampler;
+		assert(!sampler.sampleOnce(0.0f)); // 대상이 없으면 샘플하지 않는다.
+
+		int32_t handler_queue_depth = 2000;
+		sampler.setBusyLevel(&composite_busy_level, 1.0f);
+		sampler.setHandlerQueueDepthSource([&handler_queue_depth]() { return handler_queue_depth; });
+		sampler.sampleOnce(0.0f);
+		assert(BusyLevel_e::BUSY_WARN == composite_busy_level.currentBusyLevel());
+		assert(busy_resource_e::HANDLER_QUEUE_DEPTH == composite_busy_level.responsibleResource());
+
+		assert(sampler.sampleOnce(9000.0f));
+		assert(BusyLevel_e::BUSY_FATAL == composite_busy_level.currentBusyLevel());
+		assert(busy_resource_e::TICK_OVERRUN == composite_busy_level.responsibleResource());
+
+#if defined(__linux__)
+		assert(0.0f < BusyResourceSampler::readRssMb());
+
+		// 수락하지 않은 접속 수
+		int listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t address_length = sizeof(address);
+		assert(0 == bind(listen_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+		assert(0 == listen(listen_socket, 16));
+		assert(0 == getsockname(listen_socket, reinterpret_cast<sockaddr *>(&address), &address_length));
+
+		int client_sockets[3];
+		for (auto &client_socket : client_sockets)
+		{
+			client_socket = socket(AF_INET, SOCK_STREAM, 0);
+			assert(0 == connect(client_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+		}
+		accept_backlog = BusyResourceSampler::readAcceptBacklog(listen_socket);
+		assert(3 == accept_backlog);
+
+		for (auto client_socket : client_sockets)
+		{
+			close(client_socket);
+		}
+		close(listen_socket);
+#endif
+	}
+
+	printf("{\"test\":\"composite_busy_level\",\"accept_backlog\":%d}\n", accept_backlog);
+	return 0;
+}
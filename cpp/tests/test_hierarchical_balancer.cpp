@@ -0,0 +1,94 @@
+//
+// 모든 서버가 기준인원을 넘긴 후의 할당이 서버/그룹 사이에 고르게 나뉘는지 확인한다.
+
+#include "preheader.h"
+
+#include "../HierarchicalBalancer.h"
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	struct test_server_t
+	{
+		int32_t m_server_id{0};
+		int32_t m_user_count{0};
+		BusyLevel_e::TYPE m_busy_level{BusyLevel_e::BUSY_IDLE};
+
+		int32_t balanceKeyServerId() const { return m_server_id; }
+		int32_t balanceKeyUserCount() const { return m_user_count; }
+		BusyLevel_e::TYPE busyLevel() const { return m_busy_level; }
+		void setBusyLevel(BusyLevel_e::TYPE busy_level) { m_busy_level = busy_level; }
+		string_t toString() const { return string_t(); }
+	};
+
+	typedef HierarchicalBalancer<test_server_t> balancer_t;
+
+	const int32_t FILL_USER_COUNT = 10;
+
+	boost::shared_ptr<test_server_t> addServer(balancer_t &balancer, int32_t group_id, int32_t server_id)
+	{
+		auto server = boost::make_shared<test_server_t>();
+		server->m_server_id = server_id;
+		assert(!balancer.registerServer(group_id, server, FILL_USER_COUNT).fail());
+		return server;
+	}
+
+	void allocUsers(balancer_t &balancer, int32_t alloc_count)
+	{
+		for (int32_t index = 0; index < alloc_count; ++index)
+		{
+			auto server = balancer.alloc();
+			assert(server);
+			++server->m_user_count;
+			balancer.updateServer(server->m_server_id);
+		}
+	}
+
+	int32_t spread(const std::vector<boost::shared_ptr<test_server_t>> &servers)
+	{
+		auto minmax = std::minmax_element(servers.begin(), servers.end(),
+										  [](const boost::shared_ptr<test_server_t> &left, const boost::shared_ptr<test_server_t> &right) -> bool
+										  {
+											  return left->m_user_count < right->m_user_count;
+										  });
+		return (*minmax.second)->m_user_count - (*minmax.first)->m_user_count;
+	}
+} // namespace
+
+int main()
+{
+	// 한 그룹 서버 3개, 기준 10, 60명 -> 20/20/20
+	std::vector<boost::shared_ptr<test_server_t>> flat_servers;
+	{
+		balancer_t balancer;
+		balancer.addGroup(balancer_t::ROOT_GROUP_ID, 1);
+		for (int32_t server_id = 1; server_id <= 3; ++server_id)
+		{
+			flat_servers.push_back(addServer(balancer, 1, server_id));
+		}
+		allocUsers(balancer, 60);
+		assert(spread(flat_servers) <= 1);
+	}
+
+	// 그룹 A 서버 2개, 그룹 B 서버 1개, 90명 -> 그룹 인원은 서버 수에 비례하여 서버마다 30
+	std::vector<boost::shared_ptr<test_server_t>> group_servers;
+	{
+		balancer_t balancer;
+		balancer.addGroup(balancer_t::ROOT_GROUP_ID, 1);
+		balancer.addGroup(balancer_t::ROOT_GROUP_ID, 2);
+		group_servers.push_back(addServer(balancer, 1, 1));
+		group_servers.push_back(addServer(balancer, 1, 2));
+		group_servers.push_back(addServer(balancer, 2, 3));
+		allocUsers(balancer, 90);
+		assert(spread(group_servers) <= 1);
+	}
+
+	printf("{\"test\":\"hierarchical_balancer\",\"flat\":[%d,%d,%d],\"grouped\":[%d,%d,%d]}\n",
+		   flat_servers[0]->m_user_count, flat_servers[1]->m_user_count, flat_servers[2]->m_user_count,
+		   group_servers[0]->m_user_count, group_servers[1]->m_user_count, group_servers[2]->m_user_count);
+	return 0;
+}
@@ -0,0 +1,81 @@
+//
+// 로직서버 장애시 50000 세션 재배치 시간과 분배를 확인한다.
+
+#include "preheader.h"
+
+#include "../LogicServerFailover.h"
+#include <boost/make_shared.hpp>
+#include <cassert>
+#include <cstdio>
+
+namespace
+{
+	struct test_logic_server_t
+	{
+		int32_t m_server_id{0};
+		int32_t m_user_count{0};
+		BusyLevel_e::TYPE m_busy_level{BusyLevel_e::BUSY_IDLE};
+
+		int32_t balanceKeyServerId() const { return m_server_id; }
+		int32_t balanceKeyUserCount() const { return m_user_count; }
+		BusyLevel_e::TYPE busyLevel() const { return m_busy_level; }
+		void setBusyLevel(BusyLevel_e::TYPE busy_level) { m_busy_level = busy_level; }
+		string_t toString() const { return string_t(); }
+	};
+
+	const int32_t SERVER_COUNT = 8;
+	const int32_t FAILED_SERVER_ID = 1;
+	const int32_t SESSION_COUNT = 50000;
+} // namespace
+
+int main()
+{
+	ServerBalancer<test_logic_server_t> balancer;
+	std::vector<boost::shared_ptr<test_logic_server_t>> logic_servers;
+	for (int32_t server_id = 1; server_id <= SERVER_COUNT; ++server_id)
+	{
+		auto logic_server = boost::make_shared<test_logic_server_t>();
+		logic_server->m_server_id = server_id;
+		logic_server->m_user_count = server_id * 100; // 서버별 기존 인원이 다르다.
+		balancer.registerServer(logic_server);
+		logic_servers.push_back(logic_server);
+	}
+	logic_servers[SERVER_COUNT - 1]->setBusyLevel(BusyLevel_e::BUSY_ERROR); // 입장 불가 서버
+
+	std::vector<uint64_t> session_ids;
+	for (int32_t index = 0; index < SESSION_COUNT; ++index)
+	{
+		session_ids.push_back(static_cast<uint64_t>(index + 1));
+	}
+
+	std::vector<int32_t> rebind_counts(SERVER_COUNT + 1, 0);
+	int32_t batch_count = 0;
+	LogicServerFailover<test_logic_server_t> failover;
+	int32_t rebind_count = failover.rebind(FAILED_SERVER_ID, balancer, session_ids,
+										   [&](boost::shared_ptr<test_logic_server_t> logic_server, const std::vector<uint64_t> &batch)
+										   {
+											   assert(batch.size() <= 500);
+											   rebind_counts[logic_server->m_server_id] += static_cast<int32_t>(batch.size());
+											   ++batch_count;
+										   });
+
+	assert(SESSION_COUNT == rebind_count);
+	assert(0 == rebind_counts[FAILED_SERVER_ID]);
+	assert(0 == rebind_counts[SERVER_COUNT]);
+
+	// 기준인원을 모두 넘긴 후에는 사용률이 가장 작은 서버로 가므로 최종 인원 차이는 1 이하
+	int32_t min_user_count = std::numeric_limits<int32_t>::max();
+	int32_t max_user_count = 0;
+	for (int32_t server_id = 2; server_id < SERVER_COUNT; ++server_id)
+	{
+		int32_t user_count = logic_servers[server_id - 1]->m_user_count + rebind_counts[server_id];
+		min_user_count = std::min(min_user_count, user_count);
+		max_user_count = std::max(max_user_count, user_count);
+	}
+	assert(max_user_count - min_user_count <= 1);
+	assert(0 == balancer.leasePendingCount());
+
+	printf("{\"test\":\"logic_server_failover\",\"session_count\":%d,\"server_count\":%d,\"batch_count\":%d,\"recover_sec\":%.6f}\n",
+		   rebind_count, SERVER_COUNT - 2, batch_count, failover.lastRecoverSec());
+	return 0;
+}
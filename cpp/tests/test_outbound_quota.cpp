@@ -0,0 +1,164 @@
+//
+// 세션 대기열의 바이트/패킷 예산, flush에서 커널 큐 여유만큼 넘기기, 혼잡시 low 우선순위 coalesce/drop, 혼잡 해소 후 최신값 송신,
+// hard cap/패킷 수 초과와 정체 시간 초과 disconnect를 확인한다.
+
+#include "preheader.h"
+
+#include "../OutboundQuota.h"
+#include "../CompositeBusyLevel.h"
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+	void flushAll(OutboundQuota &quota, uint32_t kernel_queued_bytes)
+	{
+		std::vector<OutboundQuota::send_func_t> send_funcs;
+		assert(outbound_result_e::sent == quota.flush(kernel_queued_bytes, send_funcs));
+		for (auto &send_func : send_funcs)
+		{
+			send_func();
+		}
+		quota.endFlush();
+	}
+} // namespace
+
+int main()
+{
+	OutboundQuota::param_t param;
+	param.m_low_watermark_bytes = 1000;
+	param.m_high_watermark_bytes = 4000;
+	param.m_max_pending_bytes = 10000;
+	param.m_max_pending_packets = 16;
+	param.m_socket_window_bytes = 1000;
+	param.m_stall_disconnect_sec = 0.05f;
+
+	std::vector<int32_t> sent_values;
+	auto sender = [&sent_values](int32_t value)
+	{
+		return [&sent_values, value]() { sent_values.push_back(value); };
+	};
+
+	int32_t coalesced_count = 0;
+	{
+		OutboundQuota quota;
+		quota.setParam(param);
+
+		// window 안이면 바로, 넘으면 대기열
+		assert(outbound_result_e::sent == quota.admit(500, send_priority_e::low, 7, sender(1)));
+		assert(outbound_result_e::queued == quota.admit(600, send_priority_e::normal, 0, sender(2)));
+		assert(600 == quota.pendingBytes() && 1 == quota.pendingPackets());
+		assert(600 == OutboundQuota::totalPendingBytes());
+
+		// 타이머는 한번만 건다.
+		assert(quota.scheduleFlush());
+		assert(!quota.scheduleFlush());
+
+		// 커널 큐가 window를 채우고 있으면 넘기지 않는다.
+		std::vector<OutboundQuota::send_func_t> send_funcs;
+		assert(outbound_result_e::sent == quota.flush(900, send_funcs));
+		assert(send_funcs.empty());
+		assert(quota.endFlush());
+
+		// flush 중에 들어온 메시지는 꺼낸 메시지 뒤에 선다.
+		assert(outbound_result_e::sent == quota.flush(0, send_funcs));
+		assert(1 == send_funcs.size());
+		assert(outbound_result_e::queued == quota.admit(10, send_priority_e::normal, 0, sender(3)));
+		send_funcs.front()();
+		assert(quota.endFlush());
+		flushAll(quota, 0);
+		assert(!quota.endFlush());
+		assert((std::vector<int32_t>{1, 2, 3}) == sent_values);
+		assert(0 == quota.pendingBytes());
+
+		// 대기 바이트 high 이상 : low는 키별 최신값만, 키가 없으면 버린다. normal은 대기열에 넣는다.
+		for (int32_t value = 10; value < 15; ++value)
+		{
+			assert(outbound_result_e::queued == quota.admit(1000, send_priority_e::normal, 0, sender(value)));
+		}
+		assert(quota.isCongested());
+		assert(outbound_result_e::coalesced == quota.admit(100, send_priority_e::low, 7, sender(20)));
+		assert(outbound_result_e::coalesced == quota.admit(100, send_priority_e::low, 7, sender(21)));
+		assert(outbound_result_e::dropped == quota.admit(100, send_priority_e::low, 0, sender(22)));
+		assert(outbound_result_e::queued == quota.admit(1000, send_priority_e::high, 0, sender(15)));
+		coalesced_count = 2;
+		assert(6100 == OutboundQuota::totalPendingBytes());
+
+		// flush마다 window만큼 넘긴다. low 이하로 내려가면 보관된 최신값(21)이 대기열 뒤에 붙는다.
+		for (int32_t count = 0; count < 5; ++count)
+		{
+			flushAll(quota, 0);
+		}
+		assert(!quota.isCongested());
+		flushAll(quota, 0);
+		flushAll(quota, 0);
+		assert((std::vector<int32_t>{1, 2, 3, 10, 11, 12, 13, 14, 15, 21}) == sent_values);
+		assert(0 == OutboundQuota::totalPendingBytes());
+
+		// 혼잡이 m_stall_disconnect_sec 이상 계속되면 disconnect, 타이머만 돌아도 알 수 있다.
+		for (int32_t count = 0; count < 5; ++count)
+		{
+			quota.admit(1000, send_priority_e::normal, 0, sender(30));
+		}
+		assert(quota.isCongested());
+		std::this_thread::sleep_for(std::chrono::milliseconds(80));
+		std::vector<OutboundQuota::send_func_t> stalled_send_funcs;
+		assert(outbound_result_e::disconnect == quota.flush(1000, stalled_send_funcs));
+		assert(stalled_send_funcs.empty());
+		quota.clear();
+		assert(!quota.endFlush());
+	}
+	assert(0 == OutboundQuota::totalPendingBytes());
+
+	// 대기 패킷 수 : low는 버리고 나머지는 disconnect
+	{
+		OutboundQuota::param_t budget_param = param;
+		budget_param.m_max_pending_packets = 2;
+		OutboundQuota quota;
+		quota.setParam(budget_param);
+		assert(outbound_result_e::sent == quota.admit(1000, send_priority_e::normal, 0, sender(40)));
+		assert(outbound_result_e::queued == quota.admit(10, send_priority_e::normal, 0, sender(41)));
+		assert(outbound_result_e::queued == quota.admit(10, send_priority_e::normal, 0, sender(42)));
+		assert(!quota.isCongested());
+		assert(outbound_result_e::dropped == quota.admit(10, send_priority_e::low, 0, sender(43)));
+		assert(outbound_result_e::disconnect == quota.admit(10, send_priority_e::high, 0, sender(44)));
+	}
+
+	// 대기 바이트 hard cap
+	{
+		OutboundQuota quota;
+		quota.setParam(param);
+		assert(outbound_result_e::sent == quota.admit(1000, send_priority_e::normal, 0, sender(50)));
+		assert(outbound_result_e::queued == quota.admit(6000, send_priority_e::normal, 0, sender(51)));
+		assert(outbound_result_e::queued == quota.admit(4000, send_priority_e::normal, 0, sender(52)));
+		assert(outbound_result_e::disconnect == quota.admit(1, send_priority_e::high, 0, sender(53)));
+	}
+	assert(0 == OutboundQuota::totalPendingBytes());
+
+	// 대기 바이트 합계를 SEND_BACKLOG로 샘플한다. WARN 기준 4000 초과 -> ERROR 진입
+	BusyLevel_e::TYPE sampled_level = BusyLevel_e::BUSY_IDLE;
+	{
+		BusyLevelParam busy_level_param;
+		busy_level_param.m_sampleCount = 1;
+		busy_level_param.m_busyFatal = 10000.0f;
+		busy_level_param.m_busyError = 8000.0f;
+		busy_level_param.m_busyWarn = 4000.0f;
+		busy_level_param.m_busyIdle = 1000.0f;
+		busy_level_param.m_useLog = false;
+
+		CompositeBusyLevel composite_busy_level;
+		composite_busy_level.setup(busy_resource_e::SEND_BACKLOG, busy_level_param);
+
+		OutboundQuota quota;
+		quota.setParam(param);
+		quota.admit(1000, send_priority_e::normal, 0, sender(60));
+		quota.admit(6000, send_priority_e::normal, 0, sender(61));
+		assert(OutboundQuota::sampleSendBacklog(composite_busy_level));
+		sampled_level = composite_busy_level.currentBusyLevel();
+		assert(BusyLevel_e::BUSY_ERROR == sampled_level);
+	}
+
+	printf("{\"test\":\"outbound_quota\",\"sent\":%zu,\"coalesced\":%d,\"sampled_level\":\"%s\"}\n", sent_values.size(), coalesced_count, BusyLevel_e::ToString(sampled_level).c_str());
+	return 0;
+}
@@ -0,0 +1,270 @@
+//
+// 객체의 인원/혼잡도를 바꾼 후의 alloc 선택, 정렬 색인 선택이 기존 두번 정렬과 같은지,
+// lease 만료/확정/보고 인원 반영과 dedicated 경로, PERCENT 방식 용량 가중치 학습을 확인한다.
+
+#include "preheader.h"
+
+#include "../ServerBalancer.h"
+#include <boost/make_shared.hpp>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace
+{
+	struct test_server_t
+	{
+		int32_t m_server_id{0};
+		int32_t m_user_count{0};
+		BusyLevel_e::TYPE m_busy_level{BusyLevel_e::BUSY_IDLE};
+
+		int32_t balanceKeyServerId() const { return m_server_id; }
+		int32_t balanceKeyUserCount() const { return m_user_count; }
+		BusyLevel_e::TYPE busyLevel() const { return m_busy_level; }
+		void setBusyLevel(BusyLevel_e::TYPE busy_level) { m_busy_level = busy_level; }
+		string_t toString() const { return "server" + std::to_string(m_server_id); }
+	};
+
+	boost::shared_ptr<test_server_t> addServer(ServerBalancer<test_server_t> &balancer, int32_t server_id, int32_t user_count)
+	{
+		auto server = boost::make_shared<test_server_t>();
+		server->m_server_id = server_id;
+		server->m_user_count = user_count;
+		balancer.registerServer(server);
+		return server;
+	}
+
+	typedef ServerBalancer<test_server_t>::status_record_t status_record_t;
+
+	status_record_t statusRecord(const ServerBalancer<test_server_t> &balancer, int32_t server_id)
+	{
+		typedef ServerBalancer<test_server_t>::status_header_t status_header_t;
+		std::vector<uint8_t> buffer;
+		balancer.dumpStatus(buffer);
+
+		status_header_t header;
+		memcpy(&header, buffer.data(), sizeof(header));
+		for (uint32_t index = 0; index < header.m_server_count; ++index)
+		{
+			status_record_t record;
+			memcpy(&record, buffer.data() + sizeof(header) + sizeof(record) * index, sizeof(record));
+			if (record.m_server_id == server_id)
+			{
+				return record;
+			}
+		}
+		assert(false);
+		return status_record_t();
+	}
+
+	struct reference_server_t
+	{
+		int32_t m_server_id;
+		int32_t m_user_count;
+		int32_t m_busy_level;
+		float m_capacity_weight;
+
+		double load() const { return static_cast<double>(m_user_count) / m_capacity_weight; }
+	};
+
+	// 기존 alloc : 혼잡도 내림, 인원 내림으로 정렬한 맨앞이 입장 불가이거나 기준 이상이면 혼잡도 내림, 인원 오름으로 다시 정렬
+	// 인원은 가중치로 나눈 값으로 비교한다. 가중치가 모두 1이면 기존과 같다.
+	int32_t twoSortPick(std::vector<reference_server_t> servers, int32_t base_fill_user_count)
+	{
+		std::sort(servers.begin(), servers.end(), [](const reference_server_t &left, const reference_server_t &right) -> bool
+				  {
+					  if (left.m_busy_level != right.m_busy_level)
+					  {
+						  return left.m_busy_level > right.m_busy_level;
+					  }
+					  if (left.load() != right.load())
+					  {
+						  return left.load() > right.load();
+					  }
+					  return left.m_server_id < right.m_server_id;
+				  });
+		if (servers.front().m_busy_level >= BusyLevel_e::BUSY_WARN && servers.front().load() >= base_fill_user_count)
+		{
+			std::sort(servers.begin(), servers.end(), [](const reference_server_t &left, const reference_server_t &right) -> bool
+					  {
+						  if (left.m_busy_level != right.m_busy_level)
+						  {
+							  return left.m_busy_level > right.m_busy_level;
+						  }
+						  if (left.load() != right.load())
+						  {
+							  return left.load() < right.load();
+						  }
+						  return left.m_server_id < right.m_server_id;
+					  });
+		}
+		return (servers.front().m_busy_level < BusyLevel_e::BUSY_WARN) ? 0 : servers.front().m_server_id;
+	}
+} // namespace
+
+int main()
+{
+	// A 20명 등록 후 99명, B 90명, 기준 100 : 기준 미만중 가장 찬 A
+	{
+		ServerBalancer<test_server_t> balancer;
+		balancer.m_base_fill_user_count = 100;
+		auto server_a = addServer(balancer, 1, 20);
+		auto server_b = addServer(balancer, 2, 90);
+		server_a->m_user_count = 99;
+		balancer.updateServer(1);
+		assert(balancer.alloc() == server_a);
+
+		// 고른 후보는 현재값을 다시 읽으므로 알리지 않고 혼잡도를 낮춰도 다음 alloc부터 제외되고 혼잡도별 서버 수에도 반영된다.
+		server_a->m_busy_level = BusyLevel_e::BUSY_ERROR;
+		assert(balancer.alloc() == server_b);
+		assert(1 == balancer.busyLevelCount(BusyLevel_e::BUSY_ERROR));
+		assert(1 == balancer.busyLevelCount(BusyLevel_e::BUSY_IDLE));
+		assert(!balancer.allBusyLevelUnder(BusyLevel_e::BUSY_ERROR));
+		balancer.changeServerBusyLevel(2, BusyLevel_e::BUSY_FATAL);
+		assert(0 == balancer.busyLevelCount(BusyLevel_e::BUSY_IDLE));
+		assert(balancer.allBusyLevelUnder(BusyLevel_e::BUSY_ERROR));
+
+		string_t output;
+		balancer.toString(output);
+		assert(output == "server1 server2 ");
+		balancer.toCompactString(output);
+		assert(output == "1:99:4 2:90:3 ");
+
+		// 해제하면 혼잡도별 서버 수에서 빠진다.
+		balancer.unregisterServer(1);
+		assert(0 == balancer.busyLevelCount(BusyLevel_e::BUSY_ERROR));
+		assert(1 == balancer.busyLevelCount(BusyLevel_e::BUSY_FATAL));
+	}
+
+	// 정렬 색인 선택 == 기존 두번 정렬, 등록 후 인원/혼잡도를 바꾸고 updateServer로 알린 경우 포함
+	int32_t compared_count = 0;
+	{
+		std::mt19937 random_engine(7);
+		const int32_t busy_levels[] = {BusyLevel_e::BUSY_ERROR, BusyLevel_e::BUSY_WARN, BusyLevel_e::BUSY_IDLE};
+		for (int32_t round = 0; round < 2000; ++round)
+		{
+			ServerBalancer<test_server_t> balancer;
+			balancer.m_base_fill_user_count = 100;
+			bool weighted = (0 == round % 2);
+
+			std::vector<reference_server_t> reference_servers;
+			int32_t server_count = 1 + static_cast<int32_t>(random_engine() % 12);
+			for (int32_t server_id = 1; server_id <= server_count; ++server_id)
+			{
+				float capacity_weight = weighted ? 0.5f * static_cast<float>(1 + random_engine() % 4) : 1.0f;
+				auto server = boost::make_shared<test_server_t>();
+				server->m_server_id = server_id;
+				server->m_user_count = 10 * static_cast<int32_t>(random_engine() % 16);
+				balancer.registerServer(server, capacity_weight);
+
+				if (0 == random_engine() % 3)
+				{
+					server->m_user_count = 10 * static_cast<int32_t>(random_engine() % 16);
+					balancer.updateServer(server_id);
+				}
+				balancer.changeServerBusyLevel(server_id, static_cast<BusyLevel_e::TYPE>(busy_levels[random_engine() % 3]));
+				reference_servers.push_back(reference_server_t{server_id, server->m_user_count, static_cast<int32_t>(server->m_busy_level), capacity_weight});
+			}
+
+			auto balance_object = balancer.alloc();
+			assert((balance_object ? balance_object->m_server_id : 0) == twoSortPick(reference_servers, balancer.m_base_fill_user_count));
+			++compared_count;
+		}
+	}
+
+	// lease 만료 : 확정하지 않으면 timeout 후 만료되고 잡아둔 인원을 돌려준다.
+	{
+		ServerBalancer<test_server_t> balancer;
+		balancer.m_base_fill_user_count = 10;
+		addServer(balancer, 1, 0);
+
+		ServerBalancer<test_server_t>::balance_lease_t lease;
+		assert(balancer.alloc(lease, 0.3f));
+		assert(1 == lease.m_server_id && 1 == balancer.leasePendingCount());
+		assert(1 == statusRecord(balancer, 1).m_pending_lease_count);
+
+		assert(0 == balancer.updateLeases(0.25f));
+		assert(1 == balancer.updateLeases(0.1f));
+		assert(0 == balancer.leasePendingCount());
+		assert(0 == statusRecord(balancer, 1).m_pending_lease_count);
+		assert(balancer.confirmLease(lease.m_lease_id).fail());
+	}
+
+	// 만료 전 확정 : 만료로 세지 않고, 보고 인원이 늘면 그만큼 확정 인원을 빼고, 보고가 없어도 reconcile 시간 후 빠진다.
+	{
+		ServerBalancer<test_server_t> balancer;
+		balancer.m_base_fill_user_count = 10;
+		balancer.m_lease_reconcile_sec = 1.0f;
+		auto server = addServer(balancer, 1, 0);
+
+		ServerBalancer<test_server_t>::balance_lease_t first_lease;
+		ServerBalancer<test_server_t>::balance_lease_t second_lease;
+		assert(balancer.alloc(first_lease, 0.3f));
+		assert(balancer.alloc(second_lease, 0.3f));
+		assert(!balancer.confirmLease(first_lease.m_lease_id).fail());
+		assert(!balancer.confirmLease(second_lease.m_lease_id).fail());
+		assert(balancer.confirmLease(first_lease.m_lease_id).fail());
+		assert(0 == balancer.leasePendingCount());
+		assert(0 == balancer.updateLeases(0.5f));
+		assert(2 == statusRecord(balancer, 1).m_confirmed_lease_count);
+
+		server->m_user_count = 1;
+		balancer.updateServer(1);
+		assert(1 == statusRecord(balancer, 1).m_confirmed_lease_count);
+
+		assert(0 == balancer.updateLeases(0.8f));
+		assert(0 == statusRecord(balancer, 1).m_confirmed_lease_count);
+	}
+
+	// dedicated 경로 : 보고 인원을 다시 읽어 보고에 반영된 확정 lease를 이중으로 세지 않고,
+	// lease 인원이 사용률에 들어가 기준인원을 넘겨 할당하지 않는다. A 기준 2명, B 기준 4명(가중치 2)에 3명
+	{
+		ServerBalancer<test_server_t> balancer;
+		balancer.m_base_fill_user_count = 2;
+		auto server_a = addServer(balancer, 1, 0);
+
+		ServerBalancer<test_server_t>::balance_lease_t lease;
+		assert(balancer.alloc(lease, 10.0f) == server_a);
+		assert(!balancer.confirmLease(lease.m_lease_id).fail());
+
+		auto server_b = boost::make_shared<test_server_t>();
+		server_b->m_server_id = 2;
+		server_b->m_user_count = 3;
+		balancer.registerServer(server_b, 2.0f);
+
+		// 보고 인원 1 + 확정 1을 그대로 더하면 A가 가득 찬 것으로 보고 B로 넘어간다.
+		server_a->m_user_count = 1;
+		assert(balancer.alloc(lease, 10.0f) == server_a);
+		assert(0 == statusRecord(balancer, 1).m_confirmed_lease_count);
+		assert(1 == statusRecord(balancer, 1).m_pending_lease_count);
+
+		// 보고 1 + lease 1이면 기준인원, 보고 인원은 늘지 않았어도 B로 넘어간다.
+		assert(balancer.alloc(lease, 10.0f) == server_b);
+	}
+
+	// PERCENT 방식 : WARN 기준 = FATAL 100 * 0.8 = 80, 100명에서 평균 40이면 200명이 기준 -> 가중치 2
+	float learned_weight = 0.0f;
+	{
+		ServerBalancer<test_server_t> balancer;
+		balancer.m_base_fill_user_count = 100;
+		balancer.m_capacity_learn_rate = 1.0f;
+		addServer(balancer, 1, 100);
+
+		BusyLevel busy_level(BusyLevel::decide_method_e::PERCENT);
+		busy_level.setSampleCount(1);
+		busy_level.setBusyValue(BusyLevel_e::BUSY_FATAL, 100.0f);
+		busy_level.setBusyValue(BusyLevel_e::BUSY_ERROR, 0.95f);
+		busy_level.setBusyValue(BusyLevel_e::BUSY_WARN, 0.8f);
+		busy_level.setBusyValue(BusyLevel_e::BUSY_IDLE, 0.7f);
+		busy_level.decide(40.0f, "test");
+
+		balancer.learnCapacityWeight(1, busy_level);
+		learned_weight = balancer.capacityWeight(1);
+		assert(std::fabs(learned_weight - 2.0f) < 0.01f);
+	}
+
+	printf("{\"test\":\"server_balancer\",\"two_sort_compared\":%d,\"percent_learned_weight\":%.2f}\n", compared_count, learned_weight);
+	return 0;
+}
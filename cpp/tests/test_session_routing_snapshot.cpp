@@ -0,0 +1,133 @@
+//
+// 스냅샷 기록 중 죽은 경우(영역 하나가 깨진 경우) 직전 스냅샷으로 복구되는지 확인한다.
+
+#include "preheader.h"
+
+#include "../SessionRoutingSnapshot.h"
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+	typedef SessionRoutingSnapshot snapshot_t;
+
+	const uint32_t CAPACITY = 1024;
+	const int32_t USER_COUNT = 500;
+	const int64_t BASE_ACCOUNT_DB_ID = 1000;
+	const char *SNAPSHOT_FILE_PATH = "test_session_routing_snapshot.bin";
+
+	size_t areaOffset(uint32_t area_index)
+	{
+		size_t area_size = sizeof(snapshot_t::area_header_t) + sizeof(uint32_t) * (CAPACITY / SessionRoutingTable::BLOCK_SLOT_COUNT) + sizeof(snapshot_t::record_t) * CAPACITY;
+		return sizeof(snapshot_t::file_header_t) + area_size * area_index;
+	}
+
+	snapshot_t::area_header_t readAreaHeader(uint32_t area_index)
+	{
+		snapshot_t::area_header_t area_header;
+		std::ifstream file(SNAPSHOT_FILE_PATH, std::ios::binary);
+		file.seekg(areaOffset(area_index));
+		file.read(reinterpret_cast<char *>(&area_header), sizeof(area_header));
+		return area_header;
+	}
+
+	// 기록 도중 죽은 것처럼 seq_end를 이전값으로 돌리고 record 일부를 덮어쓴다.
+	void tearArea(uint32_t area_index, uint64_t old_seq_end)
+	{
+		std::fstream file(SNAPSHOT_FILE_PATH, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(areaOffset(area_index) + offsetof(snapshot_t::area_header_t, m_seq_end));
+		file.write(reinterpret_cast<const char *>(&old_seq_end), sizeof(old_seq_end));
+
+		std::vector<char> garbage(sizeof(snapshot_t::record_t) * 16, 0x5A);
+		file.seekp(areaOffset(area_index) + sizeof(snapshot_t::area_header_t) + sizeof(uint32_t) * (CAPACITY / SessionRoutingTable::BLOCK_SLOT_COUNT));
+		file.write(garbage.data(), garbage.size());
+	}
+
+	void updateUser(SessionRoutingTable &routing_table, uint32_t slot, int32_t index, uint16_t logic_server_id)
+	{
+		SessionRoutingTable::route_t route;
+		route.m_session_type = 1;
+		route.m_account_db_id = BASE_ACCOUNT_DB_ID + index;
+		route.m_logic_server_id = logic_server_id;
+		route.m_zone_server_id = static_cast<uint16_t>(index % 7);
+		bool updated = routing_table.update(slot, static_cast<uint64_t>(index + 1), route);
+		assert(updated);
+	}
+} // namespace
+
+int main()
+{
+	std::remove(SNAPSHOT_FILE_PATH);
+
+	// 1차 실행 : seq 1, 2 저장 후 seq 3 기록 중 죽는다.
+	{
+		SessionRoutingTable routing_table(CAPACITY);
+		snapshot_t snapshot;
+		assert(!snapshot.open(SNAPSHOT_FILE_PATH, routing_table).fail());
+		assert(0 == snapshot.resumeCount());
+
+		std::vector<uint32_t> slots;
+		for (int32_t index = 0; index < USER_COUNT; ++index)
+		{
+			slots.push_back(routing_table.allocSlot(static_cast<uint64_t>(index + 1)));
+			updateUser(routing_table, slots.back(), index, 1);
+		}
+		assert(!snapshot.save().fail());
+
+		for (int32_t index = 0; index < USER_COUNT; index += 2)
+		{
+			updateUser(routing_table, slots[index], index, 2);
+		}
+		assert(!snapshot.save().fail());
+		assert(2 == snapshot.lastSavedSeq());
+
+		for (int32_t index = 0; index < USER_COUNT; ++index)
+		{
+			updateUser(routing_table, slots[index], index, 3);
+		}
+		assert(!snapshot.save().fail());
+		assert(3 == snapshot.lastSavedSeq());
+	}
+
+	snapshot_t::area_header_t torn_area_header = readAreaHeader(0);
+	assert(3 == torn_area_header.m_seq_end);
+	tearArea(0, 1);
+
+	// 깨진 영역은 건너뛰고 seq 2 영역으로 복구한다.
+	{
+		snapshot_t snapshot;
+		assert(!snapshot.load(SNAPSHOT_FILE_PATH).fail());
+		assert(USER_COUNT == static_cast<int32_t>(snapshot.resumeCount()));
+		for (int32_t index = 0; index < USER_COUNT; ++index)
+		{
+			snapshot_t::resume_t resume;
+			assert(snapshot.findResume(BASE_ACCOUNT_DB_ID + index, resume));
+			assert((0 == index % 2 ? 2 : 1) == resume.m_logic_server_id);
+			assert(index % 7 == resume.m_zone_server_id);
+		}
+	}
+
+	// 2차 실행 : open은 이전 스냅샷을 먼저 읽고, 첫 저장은 seq 2 영역을 덮어쓰지 않는다.
+	{
+		SessionRoutingTable routing_table(CAPACITY);
+		snapshot_t snapshot;
+		assert(!snapshot.open(SNAPSHOT_FILE_PATH, routing_table).fail());
+		assert(USER_COUNT == static_cast<int32_t>(snapshot.resumeCount()));
+
+		assert(!snapshot.save().fail());
+		snapshot_t::area_header_t kept_area_header = readAreaHeader(1);
+		assert(2 == kept_area_header.m_seq_begin && 2 == kept_area_header.m_seq_end);
+
+		snapshot_t::resume_t resume;
+		assert(snapshot.takeResume(BASE_ACCOUNT_DB_ID, resume));
+		assert(2 == resume.m_logic_server_id);
+		assert(!snapshot.takeResume(BASE_ACCOUNT_DB_ID, resume));
+		assert(USER_COUNT - 1 == static_cast<int32_t>(snapshot.resumeCount()));
+	}
+
+	std::remove(SNAPSHOT_FILE_PATH);
+	printf("{\"test\":\"session_routing_snapshot\",\"result\":\"ok\"}\n");
+	return 0;
+}